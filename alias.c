@@ -1,5 +1,3 @@
-#define _XOPEN_SOURCE 500 // to use strdup
-
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,12 +6,30 @@
 #include <stdbool.h>
 #include "utils.h"
 #include "cfuhash.h"
+#include "alias.h"
 
 cfuhash_table_t *alias_table = NULL;
+static unsigned alias_gen = 0;  // bumped on every change to the table
+
+alias_t *alias_ref(alias_t *alias)
+{
+    ++alias->refs;
+    return alias;
+}
+
+void alias_unref(alias_t *alias)
+{
+    if (alias != NULL && --alias->refs == 0) free(alias);
+}
+
+static void alias_free_fn(void *data)
+{
+    alias_unref(data);
+}
 
 static void alias_delete(void)
 {
-    if (alias_table != NULL) cfuhash_destroy(alias_table);
+    if (alias_table != NULL) cfuhash_destroy_with_free_fn(alias_table, &alias_free_fn);
 }
 
 void alias_init(void)
@@ -27,12 +43,27 @@ void alias_init(void)
 bool alias_add(const char *name, const char *value)
 {
     if (alias_table == NULL || name == NULL || value == NULL) return false;
-    void *old_data = cfuhash_put(alias_table, name, strdup(value));
-    if (old_data != NULL) free(old_data);
+    size_t len = strlen(value);
+    alias_t *alias = malloc(sizeof(alias_t) + len + 1);
+    if (alias == NULL) return false;
+    alias->refs = 1;
+    alias->expanding = false;
+    alias->len = len;
+    memcpy(alias->value, value, len + 1);
+    alias_unref(cfuhash_put(alias_table, name, alias));
+    ++alias_gen;
     return true;
 }
 
 const char *alias_get(const char *name)
+{
+    alias_t *alias = alias_lookup(name);
+    return alias != NULL ? alias->value : NULL;
+}
+
+// Looks an alias up with a single hash lookup. The result is only valid until
+// the table changes, unless a reference is taken.
+alias_t *alias_lookup(const char *name)
 {
     if (alias_table == NULL || name == NULL) return NULL;
     return cfuhash_get(alias_table, name);
@@ -47,15 +78,20 @@ bool alias_in(const char *name)
 bool alias_del(const char *name)
 {
     if (alias_table == NULL || name == NULL) return false;
-    void *old_data = cfuhash_delete(alias_table, name);
-    if (old_data != NULL) free(old_data);
+    alias_unref(cfuhash_delete(alias_table, name));
+    ++alias_gen;
     return true;
 }
 
+unsigned alias_generation(void)
+{
+    return alias_gen;
+}
+
 static int alias_foreach(void *key, size_t key_size, void *data, size_t data_size, void *arg)
 {
     UNUSED_VAR(key_size); UNUSED_VAR(data_size); UNUSED_VAR(arg);
-    printf("%s=%s\n", (char *)key, (char *)data);
+    printf("%s=%s\n", (char *)key, ((alias_t *)data)->value);
     return 0;
 }
 
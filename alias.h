@@ -2,12 +2,27 @@
 #define ALIAS_H
 
 #include <stdbool.h>
+#include <stddef.h>
+
+// An alias body is shared by the table and by the alias lexer frames reading
+// it, so redefining or removing an alias in the middle of an expansion is
+// safe.
+typedef struct alias_s {
+    unsigned refs;
+    bool expanding;     // set while an alias lexer frame reads it
+    size_t len;
+    char value[];
+} alias_t;
 
 void alias_init(void);
 bool alias_add(const char *name, const char *value);
 const char *alias_get(const char *name);
 bool alias_in(const char *name);
+alias_t *alias_lookup(const char *name);
+alias_t *alias_ref(alias_t *alias);
+void alias_unref(alias_t *alias);
 bool alias_del(const char *name);
+unsigned alias_generation(void);
 void alias_print_all(void);
 
 #endif // ALIAS_H
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "arena.h"
+
+struct arena_chunk_s {
+    arena_chunk_t *next;
+    size_t size;
+    char data[] __attribute__((aligned(16)));
+};
+
+static const size_t ARENA_CHUNK_SIZE = 64 * 1024;
+static const size_t ARENA_ALIGN = 16;
+// Chunks kept for reuse by arena_reset(), in bytes
+static const size_t ARENA_KEEP_SIZE = 1024 * 1024;
+
+arena_t line_arena = ARENA_INIT;
+
+static arena_chunk_t *new_chunk(arena_t *arena, size_t size)
+{
+    if (size < ARENA_CHUNK_SIZE) size = ARENA_CHUNK_SIZE;
+    arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + size);
+    if (chunk == NULL) return NULL;
+    chunk->size = size;
+    ++arena->chunk_allocs;
+    return chunk;
+}
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    if (arena == NULL || size > SIZE_MAX - ARENA_ALIGN) return NULL;
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    arena_chunk_t *chunk = arena->chunks;
+    if (chunk == NULL || chunk->size - arena->used < size) {
+        // Move on to a spare chunk if it fits, otherwise get a new one
+        if (arena->spare != NULL && arena->spare->size >= size) {
+            chunk = arena->spare;
+            arena->spare = chunk->next;
+        } else {
+            chunk = new_chunk(arena, size);
+            if (chunk == NULL) return NULL;
+        }
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->used = 0;
+    }
+
+    void *ptr = chunk->data + arena->used;
+    arena->used += size;
+    arena->in_use += size;
+    if (arena->in_use > arena->peak) arena->peak = arena->in_use;
+    ++arena->allocs;
+    arena->bytes += size;
+    return ptr;
+}
+
+char *arena_strdup(arena_t *arena, const char *str)
+{
+    size_t len = strlen(str);
+    char *copy = arena_alloc(arena, len + 1);
+    if (copy == NULL) return NULL;
+    memcpy(copy, str, len + 1);
+    return copy;
+}
+
+static bool chunks_own(const arena_chunk_t *chunk, const char *ptr)
+{
+    for (; chunk != NULL; chunk = chunk->next) {
+        if (ptr >= chunk->data && ptr < chunk->data + chunk->size) return true;
+    }
+    return false;
+}
+
+bool arena_owns(const arena_t *arena, const void *ptr)
+{
+    return chunks_own(arena->chunks, ptr) || chunks_own(arena->spare, ptr);
+}
+
+// Frees `ptr` unless it came from `arena`, in which case it is released by
+// the next arena_reset().
+void arena_release(arena_t *arena, void *ptr)
+{
+    if (ptr != NULL && !arena_owns(arena, ptr)) free(ptr);
+}
+
+void arena_reset(arena_t *arena)
+{
+    size_t kept = 0;
+    for (arena_chunk_t *chunk = arena->spare; chunk != NULL; chunk = chunk->next) {
+        kept += chunk->size;
+    }
+    while (arena->chunks != NULL) {
+        arena_chunk_t *chunk = arena->chunks;
+        arena->chunks = chunk->next;
+        if (kept + chunk->size <= ARENA_KEEP_SIZE) {
+            kept += chunk->size;
+            chunk->next = arena->spare;
+            arena->spare = chunk;
+        } else {
+            free(chunk);
+        }
+    }
+    arena->used = 0;
+    arena->in_use = 0;
+    ++arena->resets;
+}
+
+static void free_chunks(arena_chunk_t *chunk)
+{
+    while (chunk != NULL) {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
+
+void arena_free(arena_t *arena)
+{
+    free_chunks(arena->chunks);
+    free_chunks(arena->spare);
+    arena->chunks = arena->spare = NULL;
+    arena->used = 0;
+    arena->in_use = 0;
+}
+
+void arena_print_stats(const arena_t *arena, const char *name)
+{
+    unsigned long lines = arena->resets > 0 ? arena->resets : 1;
+    printf("%s: %lu resets, %.1f allocations and %.0f bytes per reset, "
+           "%lu chunk mallocs, peak %zu bytes\n",
+           name, arena->resets, (double)arena->allocs / lines,
+           (double)arena->bytes / lines, arena->chunk_allocs, arena->peak);
+}
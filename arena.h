@@ -0,0 +1,39 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct arena_chunk_s arena_chunk_t;
+
+// A region allocator: allocations are bumped from a few large chunks and are
+// only released together by arena_reset().
+typedef struct arena_s {
+    arena_chunk_t *chunks;   // the current chunk first
+    arena_chunk_t *spare;    // kept by arena_reset() for reuse
+    size_t used;             // bytes used in the current chunk
+
+    // Statistics
+    unsigned long resets;
+    unsigned long allocs;       // since created
+    unsigned long long bytes;   // since created
+    unsigned long chunk_allocs; // mallocs done for chunks
+    size_t peak;                // the most bytes used between two resets
+    size_t in_use;
+} arena_t;
+
+#define ARENA_INIT { NULL, NULL, 0, 0, 0, 0, 0, 0, 0 }
+
+// Objects living no longer than one top-level command: tokens, alias lexer
+// frames and VM entries.
+extern arena_t line_arena;
+
+void *arena_alloc(arena_t *arena, size_t size);
+char *arena_strdup(arena_t *arena, const char *str);
+bool arena_owns(const arena_t *arena, const void *ptr);
+void arena_release(arena_t *arena, void *ptr);
+void arena_reset(arena_t *arena);
+void arena_free(arena_t *arena);
+void arena_print_stats(const arena_t *arena, const char *name);
+
+#endif // ARENA_H
@@ -7,6 +7,11 @@
 #include <stddef.h>
 #include <unistd.h>
 #include <limits.h>
+#include <signal.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <linux/limits.h>
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -16,49 +21,75 @@
 #include "states.h"
 #include "alias.h"
 #include "reader.h"
+#include "il_cache.h"
+#include "parser.h"
+#include "vm.h"
+#include "arena.h"
+#include "wordtab.h"
+#include "var.h"
+#include "path_cache.h"
+#include "exec.h"
+#include "jobs.h"
+#include "fileutil.h"
 
-bool is_builtin(vm_entry_command_t *cmd)
+const builtin_t builtins[] = {
+    { "cd",       &builtin_cd,        BUILTIN_SHELL_STATE, NULL },
+    { "exit",     &builtin_exit,      BUILTIN_SHELL_STATE, NULL },
+    { "alias",    &builtin_alias,     BUILTIN_SHELL_STATE, NULL },
+    { "debug",    &builtin_debug,     BUILTIN_SHELL_STATE, NULL },
+    { "export",   &builtin_export,    BUILTIN_SHELL_STATE, NULL },
+    { "unalias",  &builtin_unalias,   BUILTIN_SHELL_STATE, NULL },
+    { "history",  &builtin_history,   0,                   NULL },
+    { "unexport", &builtin_unexport,  BUILTIN_SHELL_STATE, NULL },
+    { "readonly", &builtin_readonly,  BUILTIN_SHELL_STATE, NULL },
+    { "integer",  &builtin_integer,   BUILTIN_SHELL_STATE, NULL },
+    { "hash",     &builtin_hash,      BUILTIN_SHELL_STATE, NULL },
+    { "jobs",     &builtin_jobs,      0,                   NULL },
+    { "wait",     &builtin_wait,      BUILTIN_SHELL_STATE, NULL },
+    { "kill",     &builtin_kill,      BUILTIN_SHELL_STATE, NULL },
+    { "true",     &builtin_true,      0,                   NULL },
+    { ":",        &builtin_true,      0,                   NULL },
+    { "false",    &builtin_false,     0,                   NULL },
+    { "echo",     &builtin_echo,      0,                   NULL },
+    { "printf",   &builtin_printf,    0,                   NULL },
+    { "test",     &builtin_test,      0,                   NULL },
+    { "[",        &builtin_bracket,   0,                   NULL },
+    { "cat",      &builtin_cat,       0,                   &builtin_cat_stream },
+    { "head",     &builtin_head,      0,                   &builtin_head_stream },
+    { "tail",     &builtin_tail,      0,                   &builtin_tail_stream },
+    { "wc",       &builtin_wc,        0,                   &builtin_wc_stream },
+};
+
+const size_t builtins_count = sizeof(builtins) / sizeof(builtins[0]);
+
+const builtin_t *find_builtin(vm_entry_command_t *cmd)
 {
-    if (cmd == NULL || cmd->args == NULL || cmd->args[0] == NULL) return false;
-    const char *c = cmd->args[0]->pl_str;
+    if (cmd == NULL || cmd->args == NULL || cmd->args[0] == NULL) return NULL;
+    const char *name = cmd->args[0]->pl_str;
+    const word_t *word = wordtab_lookup(name, strlen(name));
+    return (word != NULL && word->kind == WORD_BUILTIN) ? word->builtin : NULL;
+}
 
-    return (strcmp(c, "cd") == 0 || strcmp(c, "exit") == 0
-            || strcmp(c, "alias") == 0 || strcmp(c, "debug") == 0
-            || strcmp(c, "export") == 0 || strcmp(c, "unalias") == 0
-            || strcmp(c, "history") == 0) || strcmp(c, "unexport") == 0;
+bool is_builtin(vm_entry_command_t *cmd)
+{
+    return find_builtin(cmd) != NULL;
 }
 
 int call_builtin(vm_entry_command_t *cmd)
 {
-    if (!is_builtin(cmd)) {
+    const builtin_t *builtin = find_builtin(cmd);
+    if (builtin == NULL) {
         fputs("nsh: Not a builtin command\n", stderr);
         return -1;
     }
-    switch (cmd->args[0]->pl_str[0]) {
-    case 'c':
-        return builtin_cd(cmd);
-    case 'e':
-        if (cmd->args[0]->pl_str[2] == 'i') return builtin_exit(cmd);
-        return builtin_export(cmd);
-    case 'a':
-        return builtin_alias(cmd);
-    case 'd':
-        return builtin_debug(cmd);
-    case 'u':
-        if (cmd->args[0]->pl_str[2] == 'a') return builtin_unalias(cmd);
-        return builtin_unexport(cmd);
-    case 'h':
-        return builtin_history(cmd);
-    }
-    fprintf(stderr, "nsh: Unrecognized builtin command `%s'\n", cmd->args[0]->pl_str);
-    return -1;
+    return builtin->fn(cmd);
 }
 
 #define BUILTIN_ASSERT(x, m) do { if (!(x)) { fputs(m "\n", stderr); return -1; } } while (0)
+// Redirections are applied by exec.c before a builtin runs
 #define BUILTIN_NORMAL_ASSERT(x) \
     do { \
         BUILTIN_ASSERT(cmd != NULL && cmd->args != NULL, x ": Null parameter"); \
-        BUILTIN_ASSERT(cmd->redirs == NULL || cmd->redirs[0] == NULL, x ": Doesn't support io redirection"); \
     } while (0)
 
 
@@ -67,9 +98,9 @@ int builtin_cd(vm_entry_command_t *cmd)
     BUILTIN_NORMAL_ASSERT("cd");
     BUILTIN_ASSERT(cmd->args[1] == NULL || cmd->args[2] == NULL, "cd: Too many arguments");
 
-    char *path = NULL;
+    const char *path = NULL;
     if (cmd->args[1] == NULL) {
-        path = getenv("HOME");
+        path = var_lookup("HOME");
     } else {
         path = cmd->args[1]->pl_str;
     }
@@ -79,7 +110,7 @@ int builtin_cd(vm_entry_command_t *cmd)
     if (chdir(path) == 0) {
         char buff[PATH_MAX + 16];
         if (getcwd(buff, PATH_MAX) != NULL) {
-            setenv("PWD", buff, 1);
+            var_put("PWD", buff);
         }
         return 0;
     } else {
@@ -98,12 +129,38 @@ int builtin_exit(vm_entry_command_t *cmd)
 int builtin_debug(vm_entry_command_t *cmd)
 {
     BUILTIN_NORMAL_ASSERT("debug");
+    if (cmd->args[1] != NULL && strcmp(cmd->args[1]->pl_str, "stats") == 0) {
+        BUILTIN_ASSERT(cmd->args[2] == NULL, "debug: Too many arguments");
+        il_cache_print_stats();
+        path_cache_print_stats();
+        exec_print_stats();
+        parser_print_stats();
+        vm_print_stats();
+        arena_print_stats(&line_arena, "line arena");
+        return 0;
+    }
+    if (cmd->args[1] != NULL && strcmp(cmd->args[1]->pl_str, "uncat") == 0) {
+        BUILTIN_ASSERT(cmd->args[2] == NULL, "debug: Too many arguments");
+        state_uncat = !state_uncat;
+        printf("debug: uncat now %s\n", state_uncat ? "on" : "off");
+        return 0;
+    }
     BUILTIN_ASSERT(cmd->args[1] == NULL, "debug: Too many arguments");
     state_debug = !state_debug;
     printf("debug: now %s\n", state_debug ? "on" : "off");
     return 0;
 }
 
+// Copies the name part of `name=value`, where `end` points at the '='
+static char *copy_name(const char *name, const char *end)
+{
+    char *copy = malloc(end - name + 1);
+    if (copy == NULL) return NULL;
+    memcpy(copy, name, end - name);
+    copy[end - name] = '\0';
+    return copy;
+}
+
 int builtin_alias(vm_entry_command_t *cmd)
 {
     BUILTIN_NORMAL_ASSERT("alias");
@@ -112,53 +169,56 @@ int builtin_alias(vm_entry_command_t *cmd)
         alias_print_all();
         return 0;
     }
-    char *val = cmd->args[1]->pl_str;
-    while (*val != '=' && *val != '\0') ++val;
-    char *name = cmd->args[1]->pl_str;
-    if (*val == '\0') {
-        if (!alias_in(name)) return -1;
-        printf("%s=%s\n", name, alias_get(name));
+    const char *arg = cmd->args[1]->pl_str;
+    const char *val = strchr(arg, '=');
+    if (val == NULL) {
+        if (!alias_in(arg)) return -1;
+        printf("%s=%s\n", arg, alias_get(arg));
         return 0;
     }
-    *val++ = '\0';
-    if (!alias_add(name, val)) {
+    // Arguments may belong to a command template, so don't split in place
+    char *name = copy_name(arg, val++);
+    bool added = name != NULL && alias_add(name, val);
+    free(name);
+    if (!added) {
         fputs("alias: Add alias failed\n", stderr);
         return -1;
     }
     return 0;
 }
 
-extern char **environ;
-
 int builtin_export(vm_entry_command_t *cmd)
 {
     BUILTIN_NORMAL_ASSERT("export");
     BUILTIN_ASSERT(cmd->args[1] == NULL || cmd->args[2] == NULL, "export: Too many arguments");
     if (cmd->args[1] == NULL) {
-        for (char **e = environ; *e != NULL; ++e) {
+        for (char **e = var_environ(); *e != NULL; ++e) {
             puts(*e);
         }
         return 0;
     }
-    char *val = cmd->args[1]->pl_str;
-    while (*val != '=' && *val != '\0') ++val;
-    char *name = cmd->args[1]->pl_str;
-    if (*val == '\0') {
-        char *env = getenv(name);
+    const char *arg = cmd->args[1]->pl_str;
+    const char *val = strchr(arg, '=');
+    if (val == NULL) {
+        // Exporting a shell variable makes it an environment one
+        int slot = var_intern(arg, strlen(arg));
+        const char *env = var_get(slot);
         if (env != NULL) {
-            printf("%s=%s\n", name, env);
+            var_export(slot, true);
+            printf("%s=%s\n", arg, env);
             return 0;
         } else {
-            fprintf(stderr, "%s is not a environment variable\n", name);
+            fprintf(stderr, "%s is not a environment variable\n", arg);
             return -1;
         }
     }
-    *val++ = '\0';
-    if (setenv(name, val, 1) == -1) {
-        perror("nsh: setenv");
+    int slot = var_intern(arg, val - arg);
+    if (slot < 0 || !var_set(slot, ++val)) {
+        fputs("export: Set variable failed\n", stderr);
         return -1;
     }
-    if (strcmp(name, "HISTSIZE") == 0) {
+    var_export(slot, true);
+    if (strcmp(var_name(slot), "HISTSIZE") == 0) {
         reader_set_histsize(val);
     }
 
@@ -213,9 +273,1021 @@ int builtin_unexport(vm_entry_command_t *cmd)
     BUILTIN_NORMAL_ASSERT("unexport");
     BUILTIN_ASSERT(cmd->args[1] != NULL, "unexport: Too few arguments");
     BUILTIN_ASSERT(cmd->args[2] == NULL, "unexport: Too many arguments");
-    if (unsetenv(cmd->args[1]->pl_str) == -1) {
-        perror("nsh: unsetenv");
+    const char *name = cmd->args[1]->pl_str;
+    int slot = var_intern(name, strlen(name));
+    if (slot < 0 || !var_export(slot, false)) {
+        fputs("unexport: Remove variable failed\n", stderr);
+        return -1;
+    }
+    return 0;
+}
+
+// Shared by readonly and integer: `NAME[=VALUE]` sets the variable if a
+// value is given, then adds `flags` to it.
+static int add_var_flags(vm_entry_command_t *cmd, const char *builtin, unsigned flags)
+{
+    if (cmd->args[1] == NULL) {
+        for (int slot = 0; slot < var_count(); ++slot) {
+            const char *value = var_get(slot);
+            if (value == NULL || !(var_flags(slot) & flags)) continue;
+            printf("%s %s=%s\n", builtin, var_name(slot), value);
+        }
+        return 0;
+    }
+    const char *arg = cmd->args[1]->pl_str;
+    const char *val = strchr(arg, '=');
+    int slot = var_intern(arg, val != NULL ? (size_t)(val - arg) : strlen(arg));
+    if (slot < 0) {
+        fprintf(stderr, "%s: Add variable failed\n", builtin);
+        return -1;
+    }
+    // Set after making it integer, so the new value is the one checked
+    if (!var_add_flags(slot, flags & ~VAR_READONLY)) return -1;
+    if (val != NULL && !var_set(slot, val + 1)) return -1;
+    return var_add_flags(slot, flags) ? 0 : -1;
+}
+
+int builtin_readonly(vm_entry_command_t *cmd)
+{
+    BUILTIN_NORMAL_ASSERT("readonly");
+    BUILTIN_ASSERT(cmd->args[1] == NULL || cmd->args[2] == NULL, "readonly: Too many arguments");
+    return add_var_flags(cmd, "readonly", VAR_READONLY);
+}
+
+int builtin_integer(vm_entry_command_t *cmd)
+{
+    BUILTIN_NORMAL_ASSERT("integer");
+    BUILTIN_ASSERT(cmd->args[1] == NULL || cmd->args[2] == NULL, "integer: Too many arguments");
+    return add_var_flags(cmd, "integer", VAR_INTEGER);
+}
+
+int builtin_hash(vm_entry_command_t *cmd)
+{
+    BUILTIN_NORMAL_ASSERT("hash");
+    BUILTIN_ASSERT(cmd->args[1] == NULL || cmd->args[2] == NULL, "hash: Too many arguments");
+    if (cmd->args[1] == NULL) {
+        path_cache_print();
+        return 0;
+    }
+    const char *arg = cmd->args[1]->pl_str;
+    if (strcmp(arg, "-r") == 0) {
+        path_cache_clear();
+        return 0;
+    }
+    // Look it up again, even if it was cached
+    path_cache_forget(arg);
+    if (strchr(arg, '/') != NULL || path_cache_find(arg) == NULL) {
+        fprintf(stderr, "hash: %s: not found\n", arg);
         return -1;
     }
     return 0;
 }
+
+int builtin_jobs(vm_entry_command_t *cmd)
+{
+    BUILTIN_NORMAL_ASSERT("jobs");
+    BUILTIN_ASSERT(cmd->args[1] == NULL, "jobs: Too many arguments");
+    jobs_print();
+    return 0;
+}
+
+// `wait` waits for all background jobs, `wait -n` for the next one to finish
+// and `wait %n` or `wait PID` for that one. The status is the job's.
+int builtin_wait(vm_entry_command_t *cmd)
+{
+    BUILTIN_NORMAL_ASSERT("wait");
+    BUILTIN_ASSERT(cmd->args[1] == NULL || cmd->args[2] == NULL, "wait: Too many arguments");
+    if (cmd->args[1] == NULL) {
+        jobs_wait_all();
+        return 0;
+    }
+    const char *arg = cmd->args[1]->pl_str;
+    if (strcmp(arg, "-n") == 0) {
+        int status = jobs_wait_any();
+        return status < 0 ? 127 : status;
+    }
+    job_t *job = jobs_find(arg);
+    if (job == NULL) {
+        fprintf(stderr, "wait: %s: no such job\n", arg);
+        return 127;
+    }
+    return jobs_wait(job);
+}
+
+static const struct {
+    const char *name;
+    int sig;
+} signal_names[] = {
+    { "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT }, { "KILL", SIGKILL },
+    { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 }, { "PIPE", SIGPIPE }, { "ALRM", SIGALRM },
+    { "TERM", SIGTERM }, { "CONT", SIGCONT }, { "STOP", SIGSTOP }, { "TSTP", SIGTSTP },
+};
+
+// Accepts `-9`, `-KILL` and `-SIGKILL`. Returns -1 if unknown.
+static int parse_signal(const char *arg)
+{
+    char *end;
+    long sig = strtol(arg, &end, 10);
+    if (end != arg && *end == '\0') return (sig > 0 && sig < NSIG) ? (int)sig : -1;
+    if (strncmp(arg, "SIG", 3) == 0) arg += 3;
+    for (size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); ++i) {
+        if (strcmp(arg, signal_names[i].name) == 0) return signal_names[i].sig;
+    }
+    return -1;
+}
+
+// kill [-SIGNAL] %n|PID...
+int builtin_kill(vm_entry_command_t *cmd)
+{
+    BUILTIN_NORMAL_ASSERT("kill");
+    vm_entry_str_t **args = cmd->args + 1;
+    int sig = SIGTERM;
+    if (*args != NULL && (*args)->pl_str[0] == '-') {
+        sig = parse_signal((*args)->pl_str + 1);
+        if (sig < 0) {
+            fprintf(stderr, "kill: %s: invalid signal\n", (*args)->pl_str + 1);
+            return -1;
+        }
+        ++args;
+    }
+    BUILTIN_ASSERT(*args != NULL, "kill: Too few arguments");
+
+    int ret = 0;
+    for (; *args != NULL; ++args) {
+        const char *arg = (*args)->pl_str;
+        bool ok;
+        if (arg[0] == '%') {
+            job_t *job = jobs_find(arg);
+            if (job == NULL) {
+                fprintf(stderr, "kill: %s: no such job\n", arg);
+                ret = -1;
+                continue;
+            }
+            ok = jobs_kill(job, sig);
+        } else {
+            char *end;
+            long pid = strtol(arg, &end, 10);
+            if (end == arg || *end != '\0') {
+                fprintf(stderr, "kill: %s: arguments must be process or job IDs\n", arg);
+                ret = -1;
+                continue;
+            }
+            ok = kill((pid_t)pid, sig) == 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "kill: %s: %s\n", arg, strerror(errno));
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+int builtin_true(vm_entry_command_t *cmd)
+{
+    UNUSED_VAR(cmd);
+    return 0;
+}
+
+int builtin_false(vm_entry_command_t *cmd)
+{
+    UNUSED_VAR(cmd);
+    return 1;
+}
+
+// What decode_escape() returns besides a byte
+static const int ESCAPE_STOP = -1;  // \c, output ends here
+static const int ESCAPE_NONE = -2;  // not an escape, the backslash stands
+
+// Decodes the escape after a backslash, moving `*ps` past it. Octal is \0nnn
+// in echo and %b arguments, and \nnn in printf formats, where \0 counts as
+// the first digit.
+static int decode_escape(const char **ps, bool format)
+{
+    const char *s = *ps;
+    int c;
+    switch (*s) {
+    case 'a': c = '\a'; break;
+    case 'b': c = '\b'; break;
+    case 'e': c = '\033'; break;
+    case 'f': c = '\f'; break;
+    case 'n': c = '\n'; break;
+    case 'r': c = '\r'; break;
+    case 't': c = '\t'; break;
+    case 'v': c = '\v'; break;
+    case '\\': c = '\\'; break;
+    case 'c': *ps = s + 1; return ESCAPE_STOP;
+    case 'x':
+        if (!isxdigit((unsigned char)s[1])) return ESCAPE_NONE;
+        c = 0;
+        for (int i = 0; i < 2 && isxdigit((unsigned char)s[1]); ++i, ++s) {
+            c = c * 16 + (isdigit((unsigned char)s[1]) ? s[1] - '0' : tolower((unsigned char)s[1]) - 'a' + 10);
+        }
+        break;
+    default:
+        if (*s < '0' || *s > '7') return ESCAPE_NONE;
+        if (*s == '0' && !format) ++s;
+        c = 0;
+        for (int i = 0; i < 3 && *s >= '0' && *s <= '7'; ++i, ++s) c = c * 8 + (*s - '0');
+        *ps = s;
+        return c & 0xff;
+    }
+    *ps = s + 1;
+    return c;
+}
+
+// Writes `s` to `out` with its escapes decoded. Returns false at \c.
+static bool put_escaped(FILE *out, const char *s)
+{
+    while (*s != '\0') {
+        if (*s != '\\' || s[1] == '\0') {
+            putc(*s++, out);
+            continue;
+        }
+        const char *p = s + 1;
+        int c = decode_escape(&p, false);
+        if (c == ESCAPE_STOP) return false;
+        if (c == ESCAPE_NONE) {
+            putc(*s++, out);
+            continue;
+        }
+        putc(c, out);
+        s = p;
+    }
+    return true;
+}
+
+// echo [-neE] [STRING...], as bash and coreutils have it: -n leaves out the
+// newline and -e turns on backslash escapes, of which \c ends the output.
+int builtin_echo(vm_entry_command_t *cmd)
+{
+    BUILTIN_NORMAL_ASSERT("echo");
+    vm_entry_str_t **args = cmd->args + 1;
+    bool newline = true, escapes = false;
+    for (; *args != NULL; ++args) {
+        const char *arg = (*args)->pl_str;
+        if (arg[0] != '-' || arg[1] == '\0' || arg[1 + strspn(arg + 1, "neE")] != '\0') break;
+        for (++arg; *arg != '\0'; ++arg) {
+            if (*arg == 'n') newline = false;
+            else escapes = (*arg == 'e');
+        }
+    }
+    for (vm_entry_str_t **pa = args; *pa != NULL; ++pa) {
+        if (pa != args) putchar(' ');
+        if (!escapes) fputs((*pa)->pl_str, stdout);
+        else if (!put_escaped(stdout, (*pa)->pl_str)) return 0;
+    }
+    if (newline) putchar('\n');
+    return 0;
+}
+
+typedef struct printf_state_s {
+    vm_entry_str_t **args;  // not yet used
+    bool failed;
+} printf_state_t;
+
+static const char *printf_next(printf_state_t *st)
+{
+    return *st->args != NULL ? (*st->args++)->pl_str : NULL;
+}
+
+// A leading quote makes a number of the character after it
+static bool printf_char_constant(const char *arg)
+{
+    return arg[0] == '\'' || arg[0] == '"';
+}
+
+static void printf_check(printf_state_t *st, const char *arg, const char *end)
+{
+    if (end != arg && *end == '\0' && errno != ERANGE) return;
+    fprintf(stderr, "printf: %s: %s\n", arg, errno == ERANGE ? strerror(ERANGE) : "invalid number");
+    st->failed = true;
+}
+
+static long long printf_signed(printf_state_t *st)
+{
+    const char *arg = printf_next(st);
+    if (arg == NULL) return 0;
+    if (printf_char_constant(arg)) return (unsigned char)arg[1];
+    char *end;
+    errno = 0;
+    long long n = strtoll(arg, &end, 0);
+    printf_check(st, arg, end);
+    return n;
+}
+
+static unsigned long long printf_unsigned(printf_state_t *st)
+{
+    const char *arg = printf_next(st);
+    if (arg == NULL) return 0;
+    if (printf_char_constant(arg)) return (unsigned char)arg[1];
+    char *end;
+    errno = 0;
+    unsigned long long n = strtoull(arg, &end, 0);
+    printf_check(st, arg, end);
+    return n;
+}
+
+static double printf_double(printf_state_t *st)
+{
+    const char *arg = printf_next(st);
+    if (arg == NULL) return 0;
+    if (printf_char_constant(arg)) return (unsigned char)arg[1];
+    char *end;
+    errno = 0;
+    double n = strtod(arg, &end);
+    printf_check(st, arg, end);
+    return n;
+}
+
+// Prints `format` once, taking arguments as its conversions need them.
+// Returns false where output ends, at \c or a bad conversion.
+static bool printf_format(const char *format, printf_state_t *st)
+{
+    for (const char *s = format; *s != '\0'; ) {
+        if (*s == '\\' && s[1] != '\0') {
+            const char *p = s + 1;
+            int c = decode_escape(&p, true);
+            if (c == ESCAPE_STOP) return false;
+            if (c == ESCAPE_NONE) {
+                putchar(*s++);
+                continue;
+            }
+            putchar(c);
+            s = p;
+            continue;
+        }
+        if (*s != '%') {
+            putchar(*s++);
+            continue;
+        }
+        if (s[1] == '%') {
+            putchar('%');
+            s += 2;
+            continue;
+        }
+
+        // The directive is rebuilt for printf() with * replaced by numbers
+        // and a length fitting the argument
+        char spec[64];
+        size_t len = 0;
+        spec[len++] = *s++;
+        while (*s != '\0' && strchr("-+ #0", *s) != NULL && len < 8) spec[len++] = *s++;
+        if (*s == '*') {
+            len += sprintf(spec + len, "%d", (int)printf_signed(st));
+            ++s;
+        } else {
+            while (isdigit((unsigned char)*s) && len < 24) spec[len++] = *s++;
+        }
+        if (*s == '.') {
+            spec[len++] = *s++;
+            if (*s == '*') {
+                len += sprintf(spec + len, "%d", (int)printf_signed(st));
+                ++s;
+            } else {
+                while (isdigit((unsigned char)*s) && len < 48) spec[len++] = *s++;
+            }
+        }
+        char conv = *s++;
+        switch (conv) {
+        case 'd': case 'i':
+            strcpy(spec + len, "lld");
+            printf(spec, printf_signed(st));
+            break;
+        case 'o': case 'u': case 'x': case 'X':
+            sprintf(spec + len, "ll%c", conv);
+            printf(spec, printf_unsigned(st));
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            sprintf(spec + len, "%c", conv);
+            printf(spec, printf_double(st));
+            break;
+        case 'c': {
+            const char *arg = printf_next(st);
+            char c[2] = { arg != NULL ? arg[0] : '\0', '\0' };
+            strcpy(spec + len, "s");
+            printf(spec, c);
+            break;
+        }
+        case 's': {
+            const char *arg = printf_next(st);
+            strcpy(spec + len, "s");
+            printf(spec, arg != NULL ? arg : "");
+            break;
+        }
+        case 'b': {
+            const char *arg = printf_next(st);
+            if (arg == NULL) break;
+            bool stop;
+            if (len == 1) {
+                stop = !put_escaped(stdout, arg);
+            } else {
+                // Decoded first, so that width and precision apply to the result
+                char *buff = NULL;
+                size_t size = 0;
+                FILE *out = open_memstream(&buff, &size);
+                if (out == NULL) return false;
+                stop = !put_escaped(out, arg);
+                fclose(out);
+                strcpy(spec + len, "s");
+                printf(spec, buff);
+                free(buff);
+            }
+            if (stop) return false;
+            break;
+        }
+        default:
+            if (conv == '\0') --s;
+            fprintf(stderr, "printf: %%%c: invalid conversion\n", conv);
+            st->failed = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+// printf FORMAT [ARG...], with the format used again while arguments last
+int builtin_printf(vm_entry_command_t *cmd)
+{
+    BUILTIN_NORMAL_ASSERT("printf");
+    vm_entry_str_t **args = cmd->args + 1;
+    if (*args != NULL && args[1] != NULL && strcmp((*args)->pl_str, "--") == 0) ++args;
+    BUILTIN_ASSERT(*args != NULL, "printf: Too few arguments");
+    printf_state_t st = { args + 1, false };
+    const char *format = (*args)->pl_str;
+    while (true) {
+        vm_entry_str_t **before = st.args;
+        if (!printf_format(format, &st) || *st.args == NULL || st.args == before) break;
+    }
+    return st.failed ? 1 : 0;
+}
+
+// `test -f x -a -r x` looks at x once: stat() results last for one command
+#define TEST_STAT_CACHE 8
+
+typedef struct test_s {
+    char **args;
+    int count;
+    int pos;
+    bool error;
+    int cached;
+    struct test_stat_s {
+        const char *path;
+        bool link;      // lstat()
+        bool found;
+        struct stat st;
+    } cache[TEST_STAT_CACHE];
+} test_t;
+
+static const struct stat *test_stat(test_t *t, const char *path, bool link)
+{
+    for (int i = 0; i < t->cached; ++i) {
+        struct test_stat_s *c = &t->cache[i];
+        if (c->link == link && strcmp(c->path, path) == 0) return c->found ? &c->st : NULL;
+    }
+    // Once full, the last entry is the one replaced
+    struct test_stat_s *c = &t->cache[t->cached < TEST_STAT_CACHE ? t->cached++ : TEST_STAT_CACHE - 1];
+    c->path = path;
+    c->link = link;
+    c->found = (link ? lstat(path, &c->st) : stat(path, &c->st)) == 0;
+    return c->found ? &c->st : NULL;
+}
+
+static bool test_unary_op(const char *op)
+{
+    return op[0] == '-' && op[1] != '\0' && op[2] == '\0' && strchr("bcdefghLnprsStuwxz", op[1]) != NULL;
+}
+
+static bool test_binary_op(const char *op)
+{
+    static const char *const ops[] = {
+        "=", "!=", "<", ">", "-eq", "-ne", "-gt", "-ge", "-lt", "-le", "-nt", "-ot", "-ef",
+    };
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        if (strcmp(op, ops[i]) == 0) return true;
+    }
+    return false;
+}
+
+static long long test_integer(test_t *t, const char *arg)
+{
+    char *end;
+    errno = 0;
+    long long n = strtoll(arg, &end, 10);
+    while (isspace((unsigned char)*end)) ++end;
+    if (end == arg || *end != '\0' || errno == ERANGE) {
+        fprintf(stderr, "test: %s: integer expression expected\n", arg);
+        t->error = true;
+    }
+    return n;
+}
+
+static bool test_unary(test_t *t, const char *op, const char *arg)
+{
+    const struct stat *st;
+    switch (op[1]) {
+    case 'n': return arg[0] != '\0';
+    case 'z': return arg[0] == '\0';
+    case 'r': return access(arg, R_OK) == 0;
+    case 'w': return access(arg, W_OK) == 0;
+    case 'x': return access(arg, X_OK) == 0;
+    case 't': return isatty((int)test_integer(t, arg));
+    case 'h': case 'L':
+        st = test_stat(t, arg, true);
+        return st != NULL && S_ISLNK(st->st_mode);
+    }
+    st = test_stat(t, arg, false);
+    if (st == NULL) return false;
+    switch (op[1]) {
+    case 'b': return S_ISBLK(st->st_mode);
+    case 'c': return S_ISCHR(st->st_mode);
+    case 'd': return S_ISDIR(st->st_mode);
+    case 'e': return true;
+    case 'f': return S_ISREG(st->st_mode);
+    case 'g': return (st->st_mode & S_ISGID) != 0;
+    case 'p': return S_ISFIFO(st->st_mode);
+    case 's': return st->st_size > 0;
+    case 'S': return S_ISSOCK(st->st_mode);
+    case 'u': return (st->st_mode & S_ISUID) != 0;
+    }
+    return false;
+}
+
+static bool test_newer(const struct stat *a, const struct stat *b)
+{
+    if (a->st_mtim.tv_sec != b->st_mtim.tv_sec) return a->st_mtim.tv_sec > b->st_mtim.tv_sec;
+    return a->st_mtim.tv_nsec > b->st_mtim.tv_nsec;
+}
+
+static bool test_binary(test_t *t, const char *a, const char *op, const char *b)
+{
+    if (strcmp(op, "=") == 0) return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(a, b) != 0;
+    if (strcmp(op, "<") == 0) return strcmp(a, b) < 0;
+    if (strcmp(op, ">") == 0) return strcmp(a, b) > 0;
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0) {
+        // Copied, as looking up b may reuse a's entry
+        struct stat copy;
+        const struct stat *sa = test_stat(t, a, false);
+        if (sa != NULL) sa = memcpy(&copy, sa, sizeof(copy));
+        const struct stat *sb = test_stat(t, b, false);
+        if (op[1] == 'n') return sa != NULL && (sb == NULL || test_newer(sa, sb));
+        if (op[1] == 'o') return sb != NULL && (sa == NULL || test_newer(sb, sa));
+        return sa != NULL && sb != NULL && sa->st_dev == sb->st_dev && sa->st_ino == sb->st_ino;
+    }
+    long long x = test_integer(t, a), y = test_integer(t, b);
+    if (strcmp(op, "-eq") == 0) return x == y;
+    if (strcmp(op, "-ne") == 0) return x != y;
+    if (strcmp(op, "-gt") == 0) return x > y;
+    if (strcmp(op, "-ge") == 0) return x >= y;
+    if (strcmp(op, "-lt") == 0) return x < y;
+    return x <= y;
+}
+
+static const char *test_peek(test_t *t, int ahead)
+{
+    return t->pos + ahead < t->count ? t->args[t->pos + ahead] : NULL;
+}
+
+static bool test_or(test_t *t);
+
+// primary: ( expr ) | unary-op arg | arg binary-op arg | arg
+static bool test_primary(test_t *t)
+{
+    const char *arg = test_peek(t, 0);
+    if (arg == NULL) {
+        fputs("test: argument expected\n", stderr);
+        t->error = true;
+        return false;
+    }
+    if (strcmp(arg, "(") == 0) {
+        ++t->pos;
+        bool r = test_or(t);
+        const char *close = test_peek(t, 0);
+        if (close == NULL || strcmp(close, ")") != 0) {
+            fputs("test: `)' expected\n", stderr);
+            t->error = true;
+            return false;
+        }
+        ++t->pos;
+        return r;
+    }
+    const char *next = test_peek(t, 1);
+    if (next != NULL && test_binary_op(next) && test_peek(t, 2) != NULL) {
+        t->pos += 3;
+        return test_binary(t, arg, next, test_peek(t, -1));
+    }
+    if (test_unary_op(arg) && next != NULL) {
+        t->pos += 2;
+        return test_unary(t, arg, next);
+    }
+    ++t->pos;
+    return arg[0] != '\0';
+}
+
+static bool test_not(test_t *t)
+{
+    const char *arg = test_peek(t, 0);
+    if (arg != NULL && strcmp(arg, "!") == 0) {
+        ++t->pos;
+        return !test_not(t);
+    }
+    return test_primary(t);
+}
+
+static bool test_and(test_t *t)
+{
+    bool r = test_not(t);
+    while (test_peek(t, 0) != NULL && strcmp(test_peek(t, 0), "-a") == 0) {
+        ++t->pos;
+        r = test_not(t) && r;
+    }
+    return r;
+}
+
+static bool test_or(test_t *t)
+{
+    bool r = test_and(t);
+    while (test_peek(t, 0) != NULL && strcmp(test_peek(t, 0), "-o") == 0) {
+        ++t->pos;
+        r = test_and(t) || r;
+    }
+    return r;
+}
+
+// Up to four arguments are read by the POSIX rules, which go by their count,
+// so that e.g. `test -n` and `test ! = x` mean what they should. More are
+// parsed as an expression with ! -a -o and parentheses.
+static bool test_posix(test_t *t, int n)
+{
+    const char *a = test_peek(t, 0);
+    switch (n) {
+    case 0:
+        return false;
+    case 1:
+        ++t->pos;
+        return a[0] != '\0';
+    case 2:
+        if (strcmp(a, "!") == 0) {
+            ++t->pos;
+            return !test_posix(t, 1);
+        }
+        if (test_unary_op(a)) {
+            t->pos += 2;
+            return test_unary(t, a, test_peek(t, -1));
+        }
+        fprintf(stderr, "test: %s: unary operator expected\n", a);
+        t->error = true;
+        return false;
+    case 3:
+        if (test_binary_op(test_peek(t, 1))) {
+            t->pos += 3;
+            return test_binary(t, a, test_peek(t, -2), test_peek(t, -1));
+        }
+        if (strcmp(test_peek(t, 1), "-a") == 0 || strcmp(test_peek(t, 1), "-o") == 0) break;
+        if (strcmp(a, "!") == 0) {
+            ++t->pos;
+            return !test_posix(t, 2);
+        }
+        if (strcmp(a, "(") == 0 && strcmp(test_peek(t, 2), ")") == 0) {
+            ++t->pos;
+            bool r = test_posix(t, 1);
+            ++t->pos;
+            return r;
+        }
+        break;
+    case 4:
+        if (strcmp(a, "!") == 0) {
+            ++t->pos;
+            return !test_posix(t, 3);
+        }
+        if (strcmp(a, "(") == 0 && strcmp(test_peek(t, 3), ")") == 0) {
+            ++t->pos;
+            bool r = test_posix(t, 2);
+            ++t->pos;
+            return r;
+        }
+        break;
+    }
+    return test_or(t);
+}
+
+static int run_test(test_t *t)
+{
+    t->pos = 0;
+    t->error = false;
+    t->cached = 0;
+    bool r = test_posix(t, t->count);
+    if (!t->error && t->pos < t->count) {
+        fprintf(stderr, "test: %s: unexpected argument\n", t->args[t->pos]);
+        t->error = true;
+    }
+    return t->error ? 2 : !r;
+}
+
+// Builtins get their words as vm entries, test wants plain strings
+static char **test_args(vm_entry_str_t **args, int count)
+{
+    char **strs = arena_alloc(&line_arena, sizeof(char *) * (count + 1));
+    if (strs == NULL) return NULL;
+    for (int i = 0; i < count; ++i) strs[i] = args[i]->pl_str;
+    strs[count] = NULL;
+    return strs;
+}
+
+int builtin_test(vm_entry_command_t *cmd)
+{
+    BUILTIN_NORMAL_ASSERT("test");
+    test_t t;
+    t.count = 0;
+    while (cmd->args[t.count + 1] != NULL) ++t.count;
+    t.args = test_args(cmd->args + 1, t.count);
+    if (t.args == NULL) return 2;
+    return run_test(&t);
+}
+
+// [ EXPRESSION ], the same as test but for the closing bracket
+int builtin_bracket(vm_entry_command_t *cmd)
+{
+    BUILTIN_NORMAL_ASSERT("[");
+    test_t t;
+    t.count = 0;
+    while (cmd->args[t.count + 1] != NULL) ++t.count;
+    if (t.count == 0 || strcmp(cmd->args[t.count]->pl_str, "]") != 0) {
+        fputs("[: missing `]'\n", stderr);
+        return 2;
+    }
+    t.args = test_args(cmd->args + 1, --t.count);
+    if (t.args == NULL) return 2;
+    return run_test(&t);
+}
+
+// A stream builtin run on its own uses the shell's stdin and stdout, which
+// it writes without stdio
+#define STREAM_BUILTIN(name) \
+    int builtin_##name(vm_entry_command_t *cmd) \
+    { \
+        fflush(stdout); \
+        return builtin_##name##_stream(cmd, STDIN_FILENO, STDOUT_FILENO); \
+    }
+
+STREAM_BUILTIN(cat)
+STREAM_BUILTIN(head)
+STREAM_BUILTIN(tail)
+STREAM_BUILTIN(wc)
+
+// Opens a file operand, where "-" is the input. Returns -1 after telling why.
+static int open_operand(const char *builtin, const char *name, int in)
+{
+    if (strcmp(name, "-") == 0) return in;
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) fprintf(stderr, "%s: %s: %s\n", builtin, name, strerror(errno));
+    return fd;
+}
+
+static void close_operand(int fd, int in)
+{
+    if (fd != in) close(fd);
+}
+
+// Tells why `name` couldn't be copied and returns the status for it. Output
+// that nobody reads any more ends the builtin as SIGPIPE would, quietly.
+static int io_failed(io_result_t result, const char *builtin, const char *name)
+{
+    if (result == IO_WRITE_FAILED) {
+        if (errno == EPIPE) return 128 + SIGPIPE;
+        fprintf(stderr, "%s: write error: %s\n", builtin, strerror(errno));
+    } else {
+        fprintf(stderr, "%s: %s: %s\n", builtin, name, strerror(errno));
+    }
+    return 1;
+}
+
+static int count_args(vm_entry_str_t **args)
+{
+    int count = 0;
+    while (args[count] != NULL) ++count;
+    return count;
+}
+
+// Without file operands the input is read, as if "-" were given
+#define FOR_EACH_OPERAND(args, count, name) \
+    for (int i_ = 0; i_ < ((count) > 0 ? (count) : 1) \
+         && ((name) = (count) > 0 ? (args)[i_]->pl_str : "-", true); ++i_)
+
+// cat [-u] [FILE...]
+int builtin_cat_stream(vm_entry_command_t *cmd, int in, int out)
+{
+    BUILTIN_NORMAL_ASSERT("cat");
+    vm_entry_str_t **args = cmd->args + 1;
+    // Output is never buffered anyway
+    if (*args != NULL && strcmp((*args)->pl_str, "-u") == 0) ++args;
+    int count = count_args(args), status = 0;
+    const char *name;
+    FOR_EACH_OPERAND(args, count, name) {
+        int fd = open_operand("cat", name, in);
+        if (fd < 0) {
+            status = 1;
+            continue;
+        }
+        if (fd != in && fileutil_same(fd, out)) {
+            fprintf(stderr, "cat: %s: input file is output file\n", name);
+            status = 1;
+        } else {
+            io_result_t result = fileutil_copy(fd, out);
+            if (result != IO_OK) status = io_failed(result, "cat", name);
+        }
+        close_operand(fd, in);
+        if (status > 128) break;
+    }
+    return status;
+}
+
+// Reads the line count of head and tail from `-n N`, `-nN` or `-N`, moving
+// `*pargs` past it. tail also takes +N, counting from the start.
+static bool parse_line_count(const char *builtin, vm_entry_str_t ***pargs,
+                             unsigned long long *lines, bool *from_start)
+{
+    vm_entry_str_t **args = *pargs;
+    for (; *args != NULL && (*args)->pl_str[0] == '-' && (*args)->pl_str[1] != '\0'; ++args) {
+        const char *arg = (*args)->pl_str;
+        if (strcmp(arg, "--") == 0) {
+            ++args;
+            break;
+        }
+        const char *value = arg + 1;
+        if (arg[1] == 'n') {
+            value = arg[2] != '\0' ? arg + 2 : (args[1] != NULL ? (*++args)->pl_str : NULL);
+            if (value == NULL) {
+                fprintf(stderr, "%s: -n: Missing line count\n", builtin);
+                return false;
+            }
+        } else if (!isdigit((unsigned char)arg[1])) {
+            fprintf(stderr, "%s: %s: Invalid option\n", builtin, arg);
+            return false;
+        }
+        if (from_start != NULL) *from_start = false;
+        if (value[0] == '+' && from_start != NULL) {
+            *from_start = true;
+            ++value;
+        }
+        char *end;
+        errno = 0;
+        *lines = strtoull(value, &end, 10);
+        if (end == value || *end != '\0' || errno == ERANGE || value[0] == '-') {
+            fprintf(stderr, "%s: %s: Invalid line count\n", builtin, value);
+            return false;
+        }
+    }
+    *pargs = args;
+    return true;
+}
+
+// Shown before each file when head or tail is given more than one
+static bool put_header(int out, const char *name, bool first)
+{
+    char buff[PATH_MAX + 16];
+    int len = snprintf(buff, sizeof(buff), "%s==> %s <==\n", first ? "" : "\n", name);
+    if (len >= (int)sizeof(buff)) len = sizeof(buff) - 1;
+    return fileutil_write(out, buff, len);
+}
+
+// head [-n N] [FILE...]
+int builtin_head_stream(vm_entry_command_t *cmd, int in, int out)
+{
+    BUILTIN_NORMAL_ASSERT("head");
+    vm_entry_str_t **args = cmd->args + 1;
+    unsigned long long lines = 10;
+    if (!parse_line_count("head", &args, &lines, NULL)) return 2;
+    int count = count_args(args), status = 0;
+    const char *name;
+    FOR_EACH_OPERAND(args, count, name) {
+        int fd = open_operand("head", name, in);
+        if (fd < 0) {
+            status = 1;
+            continue;
+        }
+        io_result_t result = IO_OK;
+        if (count > 1 && !put_header(out, name, i_ == 0)) result = IO_WRITE_FAILED;
+        if (result == IO_OK) result = fileutil_head(fd, out, lines);
+        if (result != IO_OK) status = io_failed(result, "head", name);
+        close_operand(fd, in);
+        if (status > 128) break;
+    }
+    return status;
+}
+
+// tail [-n [+]N] [FILE...]
+int builtin_tail_stream(vm_entry_command_t *cmd, int in, int out)
+{
+    BUILTIN_NORMAL_ASSERT("tail");
+    vm_entry_str_t **args = cmd->args + 1;
+    unsigned long long lines = 10;
+    bool from_start = false;
+    if (!parse_line_count("tail", &args, &lines, &from_start)) return 2;
+    int count = count_args(args), status = 0;
+    const char *name;
+    FOR_EACH_OPERAND(args, count, name) {
+        int fd = open_operand("tail", name, in);
+        if (fd < 0) {
+            status = 1;
+            continue;
+        }
+        io_result_t result = IO_OK;
+        if (count > 1 && !put_header(out, name, i_ == 0)) result = IO_WRITE_FAILED;
+        if (result == IO_OK) {
+            if (from_start) result = fileutil_skip(fd, out, lines > 0 ? lines - 1 : 0);
+            else result = fileutil_tail(fd, out, lines);
+        }
+        if (result != IO_OK) status = io_failed(result, "tail", name);
+        close_operand(fd, in);
+        if (status > 128) break;
+    }
+    return status;
+}
+
+static bool put_counts(int out, const file_counts_t *counts, unsigned what, int width, const char *name)
+{
+    char buff[PATH_MAX + 80];
+    int len = 0;
+    const unsigned long long values[] = { counts->lines, counts->words, counts->bytes };
+    const unsigned flags[] = { COUNT_LINES, COUNT_WORDS, COUNT_BYTES };
+    for (int i = 0; i < 3; ++i) {
+        if (!(what & flags[i])) continue;
+        len += snprintf(buff + len, sizeof(buff) - len, len > 0 ? " %*llu" : "%*llu", width, values[i]);
+    }
+    if (name != NULL) len += snprintf(buff + len, sizeof(buff) - len, " %s", name);
+    if (len >= (int)sizeof(buff) - 1) len = sizeof(buff) - 2;
+    buff[len++] = '\n';
+    return fileutil_write(out, buff, len);
+}
+
+// Counts are padded to the digits of the largest possible one, as coreutils
+// has it: the total size of the files, or 7 when reading anything else.
+static int counts_width(vm_entry_str_t **args, int count, unsigned what, int in)
+{
+    if (count <= 1 && (what == COUNT_LINES || what == COUNT_WORDS || what == COUNT_BYTES)) return 1;
+    unsigned long long total = 0;
+    for (int i = 0; i < (count > 0 ? count : 1); ++i) {
+        struct stat st;
+        const char *name = count > 0 ? args[i]->pl_str : "-";
+        int ok = strcmp(name, "-") == 0 ? fstat(in, &st) : stat(name, &st);
+        if (ok == 0 && !S_ISREG(st.st_mode)) return 7;
+        if (ok == 0) total += st.st_size;
+    }
+    int width = 1;
+    for (; total >= 10; total /= 10) ++width;
+    return width;
+}
+
+// wc [-lwc] [FILE...]
+int builtin_wc_stream(vm_entry_command_t *cmd, int in, int out)
+{
+    BUILTIN_NORMAL_ASSERT("wc");
+    vm_entry_str_t **args = cmd->args + 1;
+    unsigned what = 0;
+    for (; *args != NULL && (*args)->pl_str[0] == '-' && (*args)->pl_str[1] != '\0'; ++args) {
+        const char *arg = (*args)->pl_str;
+        if (strcmp(arg, "--") == 0) {
+            ++args;
+            break;
+        }
+        for (++arg; *arg != '\0'; ++arg) {
+            if (*arg == 'l') what |= COUNT_LINES;
+            else if (*arg == 'w') what |= COUNT_WORDS;
+            else if (*arg == 'c') what |= COUNT_BYTES;
+            else {
+                fprintf(stderr, "wc: -%c: Invalid option\n", *arg);
+                return 2;
+            }
+        }
+    }
+    if (what == 0) what = COUNT_LINES | COUNT_WORDS | COUNT_BYTES;
+
+    int count = count_args(args), status = 0;
+    int width = counts_width(args, count, what, in);
+    file_counts_t total = { 0, 0, 0 };
+    const char *name;
+    FOR_EACH_OPERAND(args, count, name) {
+        int fd = open_operand("wc", name, in);
+        if (fd < 0) {
+            status = 1;
+            continue;
+        }
+        file_counts_t counts = { 0, 0, 0 };
+        io_result_t result = fileutil_count(fd, &counts, what);
+        close_operand(fd, in);
+        if (result == IO_OK && !put_counts(out, &counts, what, width, count > 0 ? name : NULL)) {
+            result = IO_WRITE_FAILED;
+        }
+        if (result != IO_OK) {
+            status = io_failed(result, "wc", name);
+            if (status > 128) return status;
+            continue;
+        }
+        total.lines += counts.lines;
+        total.words += counts.words;
+        total.bytes += counts.bytes;
+    }
+    if (count > 1 && !put_counts(out, &total, what, width, "total")) status = io_failed(IO_WRITE_FAILED, "wc", NULL);
+    return status;
+}
@@ -3,8 +3,33 @@
 
 #include <stdbool.h>
 
+#include <stddef.h>
+
 typedef struct vm_entry_command_s vm_entry_command_t;
 
+// Returns the exit status, or -1 for a plain failure
+typedef int (*builtin_fn_t)(vm_entry_command_t *cmd);
+
+// The same for builtins that read and write only through `in` and `out`,
+// which lets a pipeline run them on a thread of their own
+typedef int (*builtin_stream_fn_t)(vm_entry_command_t *cmd, int in, int out);
+
+typedef enum builtin_flag_e {
+    BUILTIN_SHELL_STATE = 1 << 0,   // may change the shell itself, so runs in a child in pipelines
+} builtin_flag_t;
+
+typedef struct builtin_s {
+    const char *name;
+    builtin_fn_t fn;
+    unsigned flags;
+    builtin_stream_fn_t stream;     // NULL unless `fn` just calls it with stdin and stdout
+} builtin_t;
+
+// Registered builtins, looked up through the word table (see wordtab.h)
+extern const builtin_t builtins[];
+extern const size_t builtins_count;
+
+const builtin_t *find_builtin(vm_entry_command_t *cmd);
 bool is_builtin(vm_entry_command_t *cmd);
 int call_builtin(vm_entry_command_t *cmd);
 int builtin_cd(vm_entry_command_t *cmd);
@@ -15,5 +40,25 @@ int builtin_export(vm_entry_command_t *cmd);
 int builtin_unalias(vm_entry_command_t *cmd);
 int builtin_history(vm_entry_command_t *cmd);
 int builtin_unexport(vm_entry_command_t *cmd);
+int builtin_readonly(vm_entry_command_t *cmd);
+int builtin_integer(vm_entry_command_t *cmd);
+int builtin_hash(vm_entry_command_t *cmd);
+int builtin_jobs(vm_entry_command_t *cmd);
+int builtin_wait(vm_entry_command_t *cmd);
+int builtin_kill(vm_entry_command_t *cmd);
+int builtin_true(vm_entry_command_t *cmd);
+int builtin_false(vm_entry_command_t *cmd);
+int builtin_echo(vm_entry_command_t *cmd);
+int builtin_printf(vm_entry_command_t *cmd);
+int builtin_test(vm_entry_command_t *cmd);
+int builtin_bracket(vm_entry_command_t *cmd);
+int builtin_cat(vm_entry_command_t *cmd);
+int builtin_head(vm_entry_command_t *cmd);
+int builtin_tail(vm_entry_command_t *cmd);
+int builtin_wc(vm_entry_command_t *cmd);
+int builtin_cat_stream(vm_entry_command_t *cmd, int in, int out);
+int builtin_head_stream(vm_entry_command_t *cmd, int in, int out);
+int builtin_tail_stream(vm_entry_command_t *cmd, int in, int out);
+int builtin_wc_stream(vm_entry_command_t *cmd, int in, int out);
 
 #endif // BUILTIN_H
@@ -5,169 +5,755 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include "vm_entry.h"
 #include "exec.h"
 #include "builtin.h"
 #include "utils.h"
+#include "var.h"
+#include "arena.h"
+#include "path_cache.h"
+#include "jobs.h"
+#include "states.h"
 
-static void exec_external(vm_entry_command_t *command)
+// Shown by `debug stats`
+static struct {
+    unsigned long spawns;
+    uint64_t spawn_nsec;  // time in posix_spawn() itself
+    unsigned long builtin_stages;  // run in the shell, in pipelines
+    unsigned long uncats;  // `cat FILE |` stages left out
+} exec_stats;
+
+// Returns the environment for `command`: the shell's exported variables with
+// the command's own assignments laid over them. Without assignments this is
+// the cached vector itself, otherwise a copy on the line arena.
+static char **command_envp(vm_entry_command_t *command)
 {
-    int argc = 0;
-    while(command->args[argc] != NULL) ++argc;
-    if (argc == 0) {
-        fputs("nsh: no command", stderr);
-        exit(EXIT_FAILURE);
+    char **base = var_environ();
+    int assign_count = 0;
+    while (command->assigns[assign_count] != NULL) ++assign_count;
+    if (assign_count == 0) return base;
+
+    int count = var_environ_count(), exported = count;
+    char **envp = arena_alloc(&line_arena, sizeof(char *) * (count + assign_count + 1));
+    if (envp == NULL) return base;
+    memcpy(envp, base, sizeof(char *) * count);
+    for (int i = 0; i < assign_count; ++i) {
+        vm_entry_assign_t *a = command->assigns[i];
+        size_t name_len = strlen(a->pl_name), val_len = strlen(a->pl_val);
+        char *env = arena_alloc(&line_arena, name_len + val_len + 2);
+        if (env == NULL) return base;
+        memcpy(env, a->pl_name, name_len);
+        env[name_len] = '=';
+        memcpy(env + name_len + 1, a->pl_val, val_len + 1);
+        int index = var_environ_index(var_intern(a->pl_name, name_len));
+        // A name assigned twice that isn't exported keeps its last value
+        for (int j = exported; index < 0 && j < count; ++j) {
+            if (strncmp(envp[j], env, name_len + 1) == 0) index = j;
+        }
+        envp[index >= 0 ? index : count++] = env;
     }
+    envp[count] = NULL;
+    return envp;
+}
 
-    // argv
-    char **argv = malloc(sizeof(char *) * (argc + 1));
-    if (argv == NULL) panic("nsh: malloc failed");
-    for (int i = 0; i < argc; ++i) {
-        argv[i] = command->args[i]->pl_str;
+// Finds the file to run for `command`. This happens in the parent, so that
+// the path cache outlives the child. A PATH assigned just for the command is
+// searched without the cache.
+static const char *command_path(vm_entry_command_t *command)
+{
+    const char *name = command->args[0]->pl_str;
+    if (strchr(name, '/') != NULL) return name;
+
+    const char *path = NULL;
+    for (vm_entry_assign_t **pa = command->assigns; *pa != NULL; ++pa) {
+        if (strcmp((*pa)->pl_name, "PATH") == 0) path = (*pa)->pl_val;
     }
-    argv[argc] = NULL;
+    if (path == NULL) return path_cache_find(name);
+
+    char *found = path_search(name, path);
+    if (found == NULL) return NULL;
+    char *copy = arena_strdup(&line_arena, found);
+    free(found);
+    return copy;
+}
 
-    // env
+static bool command_path_cached(vm_entry_command_t *command)
+{
+    if (strchr(command->args[0]->pl_str, '/') != NULL) return false;
     for (vm_entry_assign_t **pa = command->assigns; *pa != NULL; ++pa) {
-        setenv((*pa)->pl_name, (*pa)->pl_val, 1);
+        if (strcmp((*pa)->pl_name, "PATH") == 0) return false;
+    }
+    return true;
+}
+
+// Everything needed to start a command, worked out before starting it:
+// redirection targets are opened in the parent, so that a failure names the
+// file, and they and the pipe ends become posix_spawn() dup2 actions applied
+// in the child, in the order the old fork() path applied them.
+typedef struct spawn_plan_s {
+    const char *path;
+    char **argv;
+    char **envp;
+    posix_spawn_file_actions_t actions;
+    int nopened;
+    int *opened;  // redirection targets, closed once the command is started
+} spawn_plan_t;
+
+static void plan_close(spawn_plan_t *plan)
+{
+    for (int i = 0; i < plan->nopened; ++i) {
+        close(plan->opened[i]);
+    }
+    plan->nopened = 0;
+}
+
+// Opens a redirection target close-on-exec, above every fd the command
+// redirects, so that no dup2 action replaces a target before it is used
+static int plan_open(const char *path, int flags, int above)
+{
+    int fd = open(path, flags | O_CLOEXEC, 0644);
+    if (fd < 0 || fd > above) return fd;
+    int moved = fcntl(fd, F_DUPFD_CLOEXEC, above + 1);
+    close(fd);
+    return moved;
+}
+
+static bool plan_dup2(spawn_plan_t *plan, int fd, int to)
+{
+    int err = posix_spawn_file_actions_adddup2(&plan->actions, fd, to);
+    if (err != 0) fprintf(stderr, "nsh: %d: %s\n", fd, strerror(err));
+    return err == 0;
+}
+
+static bool plan_redirs(spawn_plan_t *plan, vm_entry_command_t *command)
+{
+    int count = 0, above = STDERR_FILENO;
+    for (vm_entry_ioredir_t **pr = command->redirs; *pr != NULL; ++pr, ++count) {
+        if ((*pr)->pl_fd > above) above = (*pr)->pl_fd;
+    }
+    plan->nopened = 0;
+    plan->opened = count > 0 ? arena_alloc(&line_arena, sizeof(int) * count) : NULL;
+    if (count > 0 && plan->opened == NULL) {
+        perror("nsh");
+        return false;
     }
 
-    // io redir
-    int new_fd;
     for (vm_entry_ioredir_t **pr = command->redirs; *pr != NULL; ++pr) {
         vm_entry_ioredir_t *e = *pr;
+        int fd = -1;
         switch (e->redir_type) {
         case IO_REDIR_INPUT:
-            if ((new_fd = openat(AT_FDCWD, e->pl_path, O_RDONLY)) < 0) perror("nsh: openat");
-            if (dup2(new_fd, e->pl_fd) < 0) perror("nsh: dup2");
-            if (new_fd >= 0) close(new_fd);
+            fd = plan_open(e->pl_path, O_RDONLY, above);
             break;
         case IO_REDIR_OUTPUT:
         case IO_REDIR_OUTPUT_CLOBBER:
-            if ((new_fd = openat(AT_FDCWD, e->pl_path, O_WRONLY | O_TRUNC | O_CREAT, 0644)) < 0) perror("nsh: openat");
-            if (dup2(new_fd, e->pl_fd) < 0) perror("nsh: dup2");
-            if (new_fd >= 0) close(new_fd);
+            fd = plan_open(e->pl_path, O_WRONLY | O_TRUNC | O_CREAT, above);
             break;
         case IO_REDIR_OUTPUT_APPEND:
-            if ((new_fd = openat(AT_FDCWD, e->pl_path, O_WRONLY | O_APPEND | O_CREAT, 0644) < 0)) perror("nsh: openat");
-            if (dup2(new_fd, e->pl_fd) < 0) perror("nsh: dup2");
-            if (new_fd >= 0) close(new_fd);
+            fd = plan_open(e->pl_path, O_WRONLY | O_APPEND | O_CREAT, above);
             break;
         case IO_REDIR_INPUT_DUP:
         case IO_REDIR_OUTPUT_DUP:
-            if (dup2(e->pl_fd2, e->pl_fd) < 0) perror("nsh: dup2");
-            break;
+            if (!plan_dup2(plan, e->pl_fd2, e->pl_fd)) return false;
+            continue;
         case IO_REDIR_INOUT:
-            if ((new_fd = openat(AT_FDCWD, e->pl_path, O_RDWR | O_CREAT, 0644) < 0)) perror("nsh: openat");
-            if (dup2(new_fd, e->pl_fd) < 0) perror("nsh: dup2");
-            if (new_fd >= 0) close(new_fd);
+            fd = plan_open(e->pl_path, O_RDWR | O_CREAT, above);
             break;
         default:
+            continue;
+        }
+        if (fd < 0) {
+            fprintf(stderr, "nsh: %s: %s\n", e->pl_path, strerror(errno));
+            return false;
+        }
+        plan->opened[plan->nopened++] = fd;
+        if (!plan_dup2(plan, fd, e->pl_fd)) return false;
+    }
+
+    // Pipe ends are close-on-exec, so only the dup2()ed copies survive
+    if (command->pipe_in >= 0 && !plan_dup2(plan, command->pipe_in, STDIN_FILENO)) return false;
+    if (command->pipe_out >= 0 && !plan_dup2(plan, command->pipe_out, STDOUT_FILENO)) return false;
+    return true;
+}
+
+// Reports why the command can't be started if it returns false
+static bool plan_spawn(spawn_plan_t *plan, vm_entry_command_t *command, const char *path)
+{
+    int argc = 0;
+    while (command->args[argc] != NULL) ++argc;
+    plan->path = path;
+    plan->nopened = 0;
+    plan->argv = arena_alloc(&line_arena, sizeof(char *) * (argc + 2));
+    if (plan->argv == NULL || posix_spawn_file_actions_init(&plan->actions) != 0) {
+        perror("nsh");
+        return false;
+    }
+    // Leave room in front for /bin/sh, see run_plan()
+    ++plan->argv;
+    for (int i = 0; i < argc; ++i) {
+        plan->argv[i] = command->args[i]->pl_str;
+    }
+    plan->argv[argc] = NULL;
+    plan->envp = command_envp(command);
+
+    if (!plan_redirs(plan, command)) {
+        plan_close(plan);
+        posix_spawn_file_actions_destroy(&plan->actions);
+        return false;
+    }
+    return true;
+}
+
+// Starts the planned command as the next stage of `job` and returns its pid,
+// or -1 with errno set after reporting why it couldn't be started.
+static pid_t run_plan(spawn_plan_t *plan, job_t *job)
+{
+    pid_t pid = -1;
+    posix_spawnattr_t attr;
+    if (!job_spawnattr(job, &attr)) {
+        plan_close(plan);
+        posix_spawn_file_actions_destroy(&plan->actions);
+        perror("nsh");
+        return -1;
+    }
+    uint64_t begin = now_nsec();
+    int err = posix_spawn(&pid, plan->path, &plan->actions, &attr, plan->argv, plan->envp);
+    if (err == ENOEXEC) {
+        // A script without #!, which execvp() used to hand to the shell
+        plan->argv[-1] = "/bin/sh";
+        plan->argv[0] = (char *)plan->path;
+        err = posix_spawn(&pid, "/bin/sh", &plan->actions, &attr, plan->argv - 1, plan->envp);
+    }
+    exec_stats.spawn_nsec += now_nsec() - begin;
+    ++exec_stats.spawns;
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&plan->actions);
+    plan_close(plan);
+    if (err != 0) {
+        fprintf(stderr, "nsh: %s: %s\n", plan->argv[0], strerror(err));
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+static int failed_status(void)
+{
+    return errno == ENOENT ? 127 : 126;
+}
+
+static void close_pipes(vm_entry_command_t **commands, int from, int to)
+{
+    for (int i = from; i < to; ++i) {
+        if (commands[i]->pipe_in >= 0) close(commands[i]->pipe_in);
+        if (commands[i]->pipe_out >= 0) close(commands[i]->pipe_out);
+        commands[i]->pipe_in = commands[i]->pipe_out = -1;
+    }
+}
+
+// Builtins run in the shell, so their redirections are applied to the
+// shell's own fds. The fds replaced are kept above the ones scripts use and
+// put back once the builtin returns.
+static const int SAVED_FD_MIN = 10;
+static const size_t BUILTIN_OUTPUT_BUFFER = 65536;
+
+typedef struct saved_fds_s {
+    int count;
+    int *fds;     // redirected
+    int *copies;  // what they were, -1 if not open
+    int *flags;   // their fd flags, FD_CLOEXEC is lost in the copy
+} saved_fds_t;
+
+static bool fd_saved(saved_fds_t *saved, int fd)
+{
+    for (int i = 0; i < saved->count; ++i) {
+        if (saved->fds[i] == fd) return true;
+    }
+    return false;
+}
+
+static bool save_fd(saved_fds_t *saved, int fd)
+{
+    if (fd_saved(saved, fd)) return true;
+    int flags = fcntl(fd, F_GETFD);
+    int copy = fcntl(fd, F_DUPFD_CLOEXEC, SAVED_FD_MIN);
+    if (copy < 0 && errno != EBADF) return false;
+    saved->fds[saved->count] = fd;
+    saved->copies[saved->count] = copy;
+    saved->flags[saved->count] = flags;
+    ++saved->count;
+    return true;
+}
+
+static void restore_fds(saved_fds_t *saved)
+{
+    for (int i = saved->count - 1; i >= 0; --i) {
+        if (saved->copies[i] >= 0) {
+            // dup2() clears FD_CLOEXEC, which keeps the shell's own fds,
+            // like the SIGCHLD signalfd, out of the commands it runs
+            dup2(saved->copies[i], saved->fds[i]);
+            if (saved->flags[i] > 0) fcntl(saved->fds[i], F_SETFD, saved->flags[i]);
+            close(saved->copies[i]);
+        } else {
+            close(saved->fds[i]);
+        }
+    }
+    saved->count = 0;
+}
+
+// Applies the redirections of `command` in the shell, as plan_redirs() has
+// them applied in a spawned child, saving each fd before it changes.
+static bool redirect_fds(vm_entry_command_t *command, saved_fds_t *saved)
+{
+    int count = 0;
+    while (command->redirs[count] != NULL) ++count;
+    saved->count = 0;
+    if (count == 0) return true;
+    saved->fds = arena_alloc(&line_arena, sizeof(int) * count);
+    saved->copies = arena_alloc(&line_arena, sizeof(int) * count);
+    saved->flags = arena_alloc(&line_arena, sizeof(int) * count);
+    if (saved->fds == NULL || saved->copies == NULL || saved->flags == NULL) {
+        perror("nsh");
+        return false;
+    }
+
+    for (vm_entry_ioredir_t **pr = command->redirs; *pr != NULL; ++pr) {
+        vm_entry_ioredir_t *e = *pr;
+        // Saved before anything is opened, as open() may return e->pl_fd itself
+        if (!save_fd(saved, e->pl_fd)) {
+            fprintf(stderr, "nsh: %d: %s\n", e->pl_fd, strerror(errno));
+            restore_fds(saved);
+            return false;
+        }
+        int fd = -1;
+        switch (e->redir_type) {
+        case IO_REDIR_INPUT:
+            fd = open(e->pl_path, O_RDONLY | O_CLOEXEC);
+            break;
+        case IO_REDIR_OUTPUT:
+        case IO_REDIR_OUTPUT_CLOBBER:
+            fd = open(e->pl_path, O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC, 0644);
+            break;
+        case IO_REDIR_OUTPUT_APPEND:
+            fd = open(e->pl_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+            break;
+        case IO_REDIR_INPUT_DUP:
+        case IO_REDIR_OUTPUT_DUP:
+            if (dup2(e->pl_fd2, e->pl_fd) < 0) {
+                fprintf(stderr, "nsh: %d: %s\n", e->pl_fd2, strerror(errno));
+                restore_fds(saved);
+                return false;
+            }
+            continue;
+        case IO_REDIR_INOUT:
+            fd = open(e->pl_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
             break;
+        default:
+            continue;
+        }
+        if (fd < 0 || (fd != e->pl_fd && dup2(fd, e->pl_fd) < 0)) {
+            fprintf(stderr, "nsh: %s: %s\n", e->pl_path, strerror(errno));
+            if (fd >= 0 && fd != e->pl_fd) close(fd);
+            restore_fds(saved);
+            return false;
+        }
+        if (fd != e->pl_fd) close(fd);
+    }
+    return true;
+}
+
+// Runs a builtin in the shell with its redirections applied. Output goes to
+// `out` if given, as a pipe takes the place of a redirected stdout in a
+// spawned child. Otherwise a redirected stdout gets a block buffered stream
+// of its own, so that long listings go out in a few writes.
+static int run_builtin(const builtin_t *builtin, vm_entry_command_t *command, FILE *out)
+{
+    fflush(stdout);
+    saved_fds_t saved;
+    if (!redirect_fds(command, &saved)) return EXIT_FAILURE;
+
+    FILE *orig = stdout, *own = NULL;
+    if (out == NULL && fd_saved(&saved, STDOUT_FILENO)) {
+        int fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, SAVED_FD_MIN);
+        if (fd >= 0 && (own = fdopen(fd, "w")) == NULL) close(fd);
+        if (own != NULL) setvbuf(own, NULL, _IOFBF, BUILTIN_OUTPUT_BUFFER);
+        out = own;
+    }
+    if (out != NULL) stdout = out;
+    int status = builtin->fn(command);
+    fflush(stdout);
+    stdout = orig;
+    if (own != NULL) fclose(own);
+    restore_fds(&saved);
+    return status < 0 ? EXIT_FAILURE : status;
+}
+
+typedef struct pipe_writer_s {
+    int fd;
+    char *buff;
+    size_t len;
+} pipe_writer_t;
+
+static void *pipe_writer(void *arg)
+{
+    pipe_writer_t *w = arg;
+    // A reader that quits early makes write() fail with EPIPE; the SIGPIPE
+    // stays pending on this thread and goes with it.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    for (size_t done = 0; done < w->len; ) {
+        ssize_t n = write(w->fd, w->buff + done, w->len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+    close(w->fd);
+    free(w->buff);
+    free(w);
+    return NULL;
+}
+
+// Hands `buff` to a thread that writes it into `fd` and then closes both, so
+// that the shell can go on starting the stages that will read it.
+static void write_in_background(int fd, char *buff, size_t len)
+{
+    pipe_writer_t *w = malloc(sizeof(pipe_writer_t));
+    pthread_t thread;
+    pthread_attr_t attr;
+    if (len > 0 && w != NULL && pthread_attr_init(&attr) == 0) {
+        w->fd = fd;
+        w->buff = buff;
+        w->len = len;
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        bool started = pthread_create(&thread, &attr, &pipe_writer, w) == 0;
+        pthread_attr_destroy(&attr);
+        if (started) return;
+    }
+    if (len > 0) perror("nsh: pthread_create");
+    free(w);
+    free(buff);
+    close(fd);
+}
+
+// A stream builtin running as a stage of a foreground pipeline, on a thread
+// that owns the stage's pipe ends and closes them when done
+typedef struct stream_stage_s {
+    const builtin_t *builtin;   // NULL for the other stages
+    vm_entry_command_t *command;
+    int in;
+    int out;
+    int status;
+    pthread_t thread;
+} stream_stage_t;
+
+static void *stream_stage(void *arg)
+{
+    stream_stage_t *s = arg;
+    // As in pipe_writer(), EPIPE ends the stage instead
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    int status = s->builtin->stream(s->command, s->in >= 0 ? s->in : STDIN_FILENO,
+                                    s->out >= 0 ? s->out : STDOUT_FILENO);
+    s->status = status < 0 ? EXIT_FAILURE : status;
+    if (s->in >= 0) close(s->in);
+    if (s->out >= 0) close(s->out);
+    return NULL;
+}
+
+// Starts a stream builtin on a thread. `*streams` has a slot per stage and is
+// allocated by the first one; run_job() joins them.
+static bool start_stream_stage(stream_stage_t **streams, int count, int stage,
+                               const builtin_t *builtin, vm_entry_command_t *e)
+{
+    if (*streams == NULL && (*streams = calloc(count, sizeof(stream_stage_t))) == NULL) return false;
+    stream_stage_t *s = &(*streams)[stage];
+    s->builtin = builtin;
+    s->command = e;
+    s->in = e->pipe_in;
+    s->out = e->pipe_out;
+    if (pthread_create(&s->thread, NULL, &stream_stage, s) != 0) {
+        s->builtin = NULL;
+        return false;
+    }
+    e->pipe_in = e->pipe_out = -1;
+    return true;
+}
+
+// A builtin in a pipeline runs in the shell when it only prints. Its output
+// is collected and written into the pipe by a thread. A stream builtin in the
+// foreground runs on a thread of its own, moving data between its pipes as it
+// comes. One that changes the shell runs in a forked child instead, so that
+// the change goes with it, as in a subshell. So does a stream builtin that
+// can't have a thread: one in the background, one with redirections, which
+// would change the shell's fds, and one reading the input of an interactive
+// shell, which may be a terminal that isn't the shell's while the job runs.
+static void run_builtin_stage(vm_entry_command_t **commands, int count, int stage,
+                              const builtin_t *builtin, job_t *job, bool fg,
+                              stream_stage_t **streams)
+{
+    vm_entry_command_t *e = commands[stage];
+    if (builtin->stream != NULL && fg && e->redirs[0] == NULL && !(e->pipe_in < 0 && jobs_control())
+            && start_stream_stage(streams, count, stage, builtin, e)) {
+        ++exec_stats.builtin_stages;
+        return;
+    }
+    if ((builtin->flags & BUILTIN_SHELL_STATE) || builtin->stream != NULL) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            job_enter_child(job);
+            saved_fds_t saved;
+            if (!redirect_fds(e, &saved)) _exit(EXIT_FAILURE);
+            if (e->pipe_in >= 0) dup2(e->pipe_in, STDIN_FILENO);
+            if (e->pipe_out >= 0) dup2(e->pipe_out, STDOUT_FILENO);
+            close_pipes(commands, 0, count);
+            // Nor the pipe ends of the stages on threads
+            for (int i = 0; *streams != NULL && i < stage; ++i) {
+                stream_stage_t *s = &(*streams)[i];
+                if (s->builtin == NULL) continue;
+                if (s->in >= 0) close(s->in);
+                if (s->out >= 0) close(s->out);
+            }
+            int status = builtin->fn(e);
+            fflush(stdout);
+            _exit(status < 0 ? EXIT_FAILURE : status);
+        }
+        if (pid < 0) {
+            perror("nsh: fork");
+            job_finished(job, stage, EXIT_FAILURE);
+        } else {
+            job_started(job, stage, pid);
+        }
+        return;
+    }
+
+    int status;
+    if (e->pipe_out < 0) {
+        status = run_builtin(builtin, e, NULL);
+    } else {
+        char *buff = NULL;
+        size_t len = 0;
+        FILE *out = open_memstream(&buff, &len);
+        if (out == NULL) {
+            perror("nsh: open_memstream");
+            job_finished(job, stage, EXIT_FAILURE);
+            return;
+        }
+        status = run_builtin(builtin, e, out);
+        fclose(out);
+        write_in_background(e->pipe_out, buff, len);
+        e->pipe_out = -1;
+    }
+    ++exec_stats.builtin_stages;
+    job_finished(job, stage, status);
+}
+
+// The words of the commands, as `jobs` shows them
+static char *job_text(vm_entry_command_t **commands, int count)
+{
+    size_t len = 0;
+    for (int i = 0; i < count; ++i) {
+        for (vm_entry_str_t **pa = commands[i]->args; *pa != NULL; ++pa) len += strlen((*pa)->pl_str) + 1;
+        len += 2;
+    }
+    char *text = malloc(len + 1);
+    if (text == NULL) return NULL;
+    char *p = text;
+    for (int i = 0; i < count; ++i) {
+        if (i > 0) p = stpcpy(p, "| ");
+        for (vm_entry_str_t **pa = commands[i]->args; *pa != NULL; ++pa) {
+            p = stpcpy(p, (*pa)->pl_str);
+            *p++ = ' ';
+        }
+    }
+    strcpy(p, "&");
+    return text;
+}
+
+// A pipeline starting with `cat FILE |` gives the next stage FILE itself as
+// its input, which saves a stage and a copy of the data, and lets the stage
+// seek in it. It is done when cat is the builtin with one operand and no
+// redirections, and FILE is a regular file that opens, so that nothing
+// differs but the stage's input being seekable. The cat stage still shows
+// in PIPESTATUS and `jobs`, with status 0. `debug uncat` turns it off.
+// Returns the open FILE or -1.
+static int uncat_input(vm_entry_command_t **commands, int count)
+{
+    vm_entry_command_t *cat = commands[0];
+    if (!state_uncat || count < 2 || strcmp(cat->args[0]->pl_str, "cat") != 0
+            || find_builtin(cat) == NULL || cat->args[1] == NULL || cat->args[2] != NULL
+            || cat->args[1]->pl_str[0] == '-' || cat->assigns[0] != NULL || cat->redirs[0] != NULL) {
+        return -1;
+    }
+    const char *path = cat->args[1]->pl_str;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    ++exec_stats.uncats;
+    if (state_debug) printf("exec: %s reads %s itself, without cat\n", commands[1]->args[0]->pl_str, path);
+    return fd;
+}
+
+// Starts `commands` as the stages of one job, joined by pipes, and waits for
+// them unless in the background. With an `input` from uncat_input(), the
+// first stage is left out and the second reads that instead.
+static void run_job(vm_entry_command_t **commands, int count, int *ret, bool fg, int input)
+{
+    // Output from builtins comes first
+    fflush(stdout);
+    job_t *job = job_new(count);
+    if (job == NULL) {
+        perror("nsh");
+        if (input >= 0) close(input);
+        *ret = EXIT_FAILURE;
+        return;
+    }
+    for (int i = 0; i < count; ++i) commands[i]->pipe_in = commands[i]->pipe_out = -1;
+    if (input >= 0) commands[1]->pipe_in = input;
+    for (int i = (input >= 0); i + 1 < count; ++i) {
+        int fds[2];
+        if (pipe(fds) == -1) {
+            perror("nsh: pipe");
+            close_pipes(commands, 0, count);
+            job_free(job);
+            *ret = EXIT_FAILURE;
+            return;
         }
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        commands[i]->pipe_out = fds[1];
+        commands[i + 1]->pipe_in = fds[0];
     }
 
-    // pipe
-    if (command->pipe_in >= 0) {
-        if (dup2(command->pipe_in, STDIN_FILENO) < 0) perror("nsh: dup2");
-        close(command->pipe_in);
+    // Each command starts as soon as it is planned. One that can't be
+    // started gets no process; the commands around it see end of file or
+    // SIGPIPE, as if it had exited at once.
+    stream_stage_t *streams = NULL;
+    for (int i = 0; i < count; ++i) {
+        vm_entry_command_t *e = commands[i];
+        if (i == 0 && input >= 0) {
+            job_finished(job, 0, EXIT_SUCCESS);
+            continue;
+        }
+        const builtin_t *builtin = find_builtin(e);
+        if (builtin != NULL) {
+            run_builtin_stage(commands, count, i, builtin, job, fg, &streams);
+            close_pipes(commands, i, i + 1);
+            continue;
+        }
+        const char *path = command_path(e);
+        spawn_plan_t plan;
+        pid_t pid;
+        if (path == NULL) {
+            fprintf(stderr, "nsh: %s: command not found\n", e->args[0]->pl_str);
+            job_finished(job, i, 127);
+        } else if (!plan_spawn(&plan, e, path)) {
+            job_finished(job, i, EXIT_FAILURE);
+        } else if ((pid = run_plan(&plan, job)) < 0) {
+            job_finished(job, i, failed_status());
+        } else {
+            job_started(job, i, pid);
+        }
+        close_pipes(commands, i, i + 1);
     }
-    if (command->pipe_out >= 0) {
-        if (dup2(command->pipe_out, STDOUT_FILENO) < 0) perror("nsh: dup2");
-        close(command->pipe_out);
+    if (!fg) {
+        if (job->running == 0 || !jobs_add(job, job_text(commands, count))) {
+            job_free(job);
+            return;
+        }
+        if (jobs_control()) {
+            pid_t last = -1;
+            for (int i = 0; i < count; ++i) if (job->pids[i] > 0) last = job->pids[i];
+            printf("[%d] %d\n", job->id, (int)last);
+        }
+        return;
     }
 
-    execvp(command->args[0]->pl_str, argv);
-    perror("nsh");
-    exit(EXIT_FAILURE);
+    *ret = job_wait(job);
+    if (streams != NULL) {
+        for (int i = 0; i < count; ++i) {
+            if (streams[i].builtin == NULL) continue;
+            pthread_join(streams[i].thread, NULL);
+            job_finished(job, i, streams[i].status);
+        }
+        *ret = job->statuses[count - 1];
+        free(streams);
+    }
+    jobs_set_pipestatus(job->statuses, count);
+    for (int i = 0; i < count; ++i) {
+        // The file may have gone since it was cached
+        if (job->statuses[i] == 127 && job->pids[i] >= 0 && command_path_cached(commands[i])) {
+            path_cache_forget(commands[i]->args[0]->pl_str);
+        }
+    }
+    job_free(job);
 }
 
 void exec_command(vm_entry_command_t *command, int *ret, bool fg)
 {
     int tmp = 0;
     if (ret == NULL) ret = &tmp;
-    if (is_builtin(command)) {
-        if (!fg) { fputs("nsh: Can't put builtin commands into background\n", stderr); return; }
-        *ret = call_builtin(command);
+    const builtin_t *builtin = find_builtin(command);
+    // In the background a builtin is a job of one stage, see run_builtin_stage().
+    // So is a stream builtin under job control, which may read the terminal
+    // for as long as it likes, and has to get ^C in a process group of its own.
+    if (builtin != NULL && fg && !(builtin->stream != NULL && jobs_control())) {
+        *ret = run_builtin(builtin, command, NULL);
+        jobs_set_pipestatus(ret, 1);
         return;
     }
     if (command->args[0] == NULL) {
         fputs("nsh: Empty commands not allowed here", stderr);
         return;
     }
-
-    pid_t pid;
-    if ((pid = fork()) == 0) {
-        if (!fg) { if (fork() != 0) exit(EXIT_SUCCESS); }
-        command->pipe_in = command->pipe_out = -1;
-        exec_external(command);
-        exit(EXIT_FAILURE);
-    } else {
-        if (waitpid(pid, ret, 0) == -1) perror("nsh: waitpid");
-    }
+    jobs_reap();
+    run_job(&command, 1, ret, fg, -1);
 }
 
 void exec_pipeline(vm_entry_pipeline_t *pipeline, int *ret, bool fg)
 {
     int tmp = 0;
     if (ret == NULL) ret = &tmp;
-    pid_t pid;
-    int fds[2];
 
     if (pipeline == NULL || pipeline->commands[0] == NULL) return;
-    if (pipeline->commands[1] == NULL) exec_command(pipeline->commands[0], ret, fg);
+    if (pipeline->commands[1] == NULL) {
+        exec_command(pipeline->commands[0], ret, fg);
+        return;
+    }
 
-    for (vm_entry_command_t **pe = pipeline->commands; *pe != NULL; ++pe) {
-        vm_entry_command_t *e = *pe;
-        if (is_builtin(e)) {
-            fputs("nsh: Builtin commands not allowed in pipelines", stderr);
-            return;
-        }
+    int count = 0;
+    for (; pipeline->commands[count] != NULL; ++count) {
+        vm_entry_command_t *e = pipeline->commands[count];
         if (e->args[0] == NULL) {
             fputs("nsh: Empty commands not allowed in pipelines", stderr);
             return;
         }
     }
+    jobs_reap();
+    run_job(pipeline->commands, count, ret, fg, uncat_input(pipeline->commands, count));
+}
 
-    if ((pid = fork()) == 0) {
-        if (!fg) { if (fork() != 0) exit(EXIT_SUCCESS); }
-
-        vm_entry_command_t *left = pipeline->commands[0], *right = pipeline->commands[1];
-        for (int i = 1; right != NULL; right = pipeline->commands[++i]) {
-            if (pipe(fds) == -1) {
-                perror("nsh: pipe");
-                exit(EXIT_FAILURE);
-            }
-            left->pipe_out = fds[1];
-            right->pipe_in = fds[0];
-            left = right;
-        }
-
-        pid_t last_pid = -1;
-        for (vm_entry_command_t **pe = pipeline->commands; *pe != NULL; ++pe) {
-            vm_entry_command_t *e = *pe;
-            if ((last_pid = fork()) == 0) {
-                exec_external(e);
-                exit(EXIT_FAILURE);
-            } else {
-                if (e->pipe_in >= 0) close(e->pipe_in);
-                if (e->pipe_out >= 0) close(e->pipe_out);
-            }
-        }
-
-        int status, last_ret = EXIT_FAILURE;
-        pid_t wpid;
-        while ((wpid = wait(&status)) > 0) {
-            if (wpid != last_pid) continue;
-            if (WIFEXITED(status)) last_ret = WEXITSTATUS(status);
-        }
-        exit(last_ret);
-
-    } else {
-        if (waitpid(pid, ret, 0) == -1) perror("nsh: waitpid");
-    }
+void exec_print_stats(void)
+{
+    double msecs = exec_stats.spawn_nsec / 1e6;
+    printf("exec: %lu spawns in %.3f ms (%.1f us each), %lu builtin stages in the shell, %lu cats left out\n",
+           exec_stats.spawns, msecs, exec_stats.spawns > 0 ? msecs * 1e3 / exec_stats.spawns : 0.0,
+           exec_stats.builtin_stages, exec_stats.uncats);
 }
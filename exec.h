@@ -11,5 +11,6 @@ static const bool BACKGROUND = false;
 
 void exec_command(vm_entry_command_t *command, int *ret, bool fg);
 void exec_pipeline(vm_entry_pipeline_t *pipeline, int *ret, bool fg);
+void exec_print_stats(void);
 
 #endif // EXEC_H
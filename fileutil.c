@@ -0,0 +1,261 @@
+#define _GNU_SOURCE  // splice(), copy_file_range() and memrchr()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/sendfile.h>
+#include "fileutil.h"
+#include "scan.h"
+
+#define IO_BLOCK 65536
+static const size_t IO_CHUNK = 1 << 30;  // per copy_file_range(), splice() or sendfile()
+static const size_t TAIL_TRIM = 1 << 20;  // kept from a stream before looking for the tail
+
+bool fileutil_write(int out, const char *buff, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(out, buff, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buff += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Whether `in` is the regular file `out` writes into, which `cat` refuses
+bool fileutil_same(int in, int out)
+{
+    struct stat si, so;
+    return fstat(in, &si) == 0 && fstat(out, &so) == 0 && S_ISREG(si.st_mode)
+        && si.st_dev == so.st_dev && si.st_ino == so.st_ino;
+}
+
+static io_result_t copy_blocks(int in, int out)
+{
+    char buff[IO_BLOCK];
+    while (true) {
+        ssize_t n = read(in, buff, sizeof(buff));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return IO_READ_FAILED;
+        if (n == 0) return IO_OK;
+        if (!fileutil_write(out, buff, n)) return IO_WRITE_FAILED;
+    }
+}
+
+// Errors that only the write side can cause. Any other error from the
+// kernel copies may mean they don't apply to these fds, and the copy goes on
+// through a buffer, which finds out what is wrong if anything is.
+static bool write_error(int err)
+{
+    return err == EPIPE || err == ENOSPC || err == EDQUOT || err == EFBIG;
+}
+
+// Copies what is left of `in` into `out`
+io_result_t fileutil_copy(int in, int out)
+{
+    struct stat si, so;
+    if (fstat(in, &si) != 0 || fstat(out, &so) != 0) return copy_blocks(in, out);
+    bool in_file = S_ISREG(si.st_mode), out_file = S_ISREG(so.st_mode);
+    bool pipes = S_ISFIFO(si.st_mode) || S_ISFIFO(so.st_mode);
+    if (!in_file && !pipes) return copy_blocks(in, out);
+
+    while (true) {
+        ssize_t n;
+        if (in_file && out_file) n = copy_file_range(in, NULL, out, NULL, IO_CHUNK, 0);
+        else if (pipes) n = splice(in, NULL, out, NULL, IO_CHUNK, SPLICE_F_MOVE);
+        else n = sendfile(out, in, NULL, IO_CHUNK);
+        if (n > 0) continue;
+        if (n == 0) return IO_OK;
+        if (errno == EINTR) continue;
+        if (write_error(errno)) return IO_WRITE_FAILED;
+        return copy_blocks(in, out);
+    }
+}
+
+// Copies the first `lines` lines of `in`. What was read past them is given
+// back to a seekable `in`, for whatever reads it next.
+io_result_t fileutil_head(int in, int out, unsigned long long lines)
+{
+    char buff[IO_BLOCK];
+    while (lines > 0) {
+        ssize_t n = read(in, buff, sizeof(buff));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return IO_READ_FAILED;
+        if (n == 0) break;
+        const char *p = buff, *end = buff + n;
+        while (lines > 0 && p != end) {
+            const char *nl = memchr(p, '\n', end - p);
+            if (nl == NULL) {
+                p = end;
+                break;
+            }
+            p = nl + 1;
+            --lines;
+        }
+        if (!fileutil_write(out, buff, p - buff)) return IO_WRITE_FAILED;
+        if (p != end) lseek(in, p - end, SEEK_CUR);
+    }
+    return IO_OK;
+}
+
+// Returns where the last `lines` lines of `buff` start. A newline at the
+// very end ends the last line and doesn't start another.
+static size_t tail_offset(const char *buff, size_t len, unsigned long long lines)
+{
+    if (lines == 0) return len;
+    size_t i = (len > 0 && buff[len - 1] == '\n') ? len - 1 : len;
+    while (i > 0) {
+        const char *nl = memrchr(buff, '\n', i);
+        if (nl == NULL) break;
+        if (--lines == 0) return nl - buff + 1;
+        i = nl - buff;
+    }
+    return 0;
+}
+
+// Finds where the last `lines` lines of the regular file `in` start, reading
+// blocks backwards from its end. Returns -1 if it can't be read.
+static off_t tail_seek(int in, off_t begin, off_t end, unsigned long long lines)
+{
+    if (lines == 0) return end;
+    char buff[IO_BLOCK];
+    bool last = true;
+    for (off_t pos = end; pos > begin; ) {
+        size_t len = (pos - begin < (off_t)sizeof(buff)) ? (size_t)(pos - begin) : sizeof(buff);
+        pos -= len;
+        if (pread(in, buff, len, pos) != (ssize_t)len) return -1;
+        size_t i = len;
+        if (last && buff[len - 1] == '\n') --i;
+        last = false;
+        while (i > 0) {
+            const char *nl = memrchr(buff, '\n', i);
+            if (nl == NULL) break;
+            if (--lines == 0) return pos + (nl - buff) + 1;
+            i = nl - buff;
+        }
+    }
+    return begin;
+}
+
+// Copies the last `lines` lines of `in`. A regular file is read from its end;
+// anything else is read through, keeping only enough of it.
+io_result_t fileutil_tail(int in, int out, unsigned long long lines)
+{
+    struct stat st;
+    off_t begin;
+    if (fstat(in, &st) == 0 && S_ISREG(st.st_mode) && (begin = lseek(in, 0, SEEK_CUR)) >= 0
+            && begin <= st.st_size) {
+        off_t start = tail_seek(in, begin, st.st_size, lines);
+        if (start >= 0 && lseek(in, start, SEEK_SET) == start) return fileutil_copy(in, out);
+    }
+
+    char *buff = NULL;
+    size_t len = 0, size = 0;
+    io_result_t result = IO_OK;
+    while (true) {
+        if (size - len < IO_BLOCK) {
+            char *bigger = realloc(buff, size + IO_BLOCK);
+            if (bigger == NULL) {
+                result = IO_READ_FAILED;
+                break;
+            }
+            buff = bigger;
+            size += IO_BLOCK;
+        }
+        ssize_t n = read(in, buff + len, size - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            result = IO_READ_FAILED;
+            break;
+        }
+        if (n == 0) break;
+        len += n;
+        if (len >= TAIL_TRIM) {
+            size_t start = tail_offset(buff, len, lines);
+            memmove(buff, buff + start, len - start);
+            len -= start;
+        }
+    }
+    if (result == IO_OK) {
+        size_t start = tail_offset(buff, len, lines);
+        if (!fileutil_write(out, buff + start, len - start)) result = IO_WRITE_FAILED;
+    }
+    free(buff);
+    return result;
+}
+
+// Copies `in` from its line after the first `lines`, for `tail -n +N`
+io_result_t fileutil_skip(int in, int out, unsigned long long lines)
+{
+    char buff[IO_BLOCK];
+    while (lines > 0) {
+        ssize_t n = read(in, buff, sizeof(buff));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return IO_READ_FAILED;
+        if (n == 0) return IO_OK;
+        const char *p = buff, *end = buff + n;
+        while (lines > 0) {
+            const char *nl = memchr(p, '\n', end - p);
+            if (nl == NULL) break;
+            p = nl + 1;
+            --lines;
+        }
+        if (lines == 0 && !fileutil_write(out, p, end - p)) return IO_WRITE_FAILED;
+    }
+    return fileutil_copy(in, out);
+}
+
+static void count_block(const char *p, const char *end, file_counts_t *counts, unsigned what, bool *in_word)
+{
+    counts->bytes += end - p;
+    if (what & COUNT_LINES) counts->lines += scan_count(p, end, '\n');
+    if (!(what & COUNT_WORDS)) return;
+    for (; p != end; ++p) {
+        bool space = isspace((unsigned char)*p);
+        if (!space && !*in_word) ++counts->words;
+        *in_word = !space;
+    }
+}
+
+// Adds up what is left of `in`, counting `what` (COUNT_*) of it. A regular
+// file is mapped rather than read, and not even that for its size alone.
+io_result_t fileutil_count(int in, file_counts_t *counts, unsigned what)
+{
+    bool in_word = false;
+    struct stat st;
+    off_t begin;
+    if (fstat(in, &st) == 0 && S_ISREG(st.st_mode) && (begin = lseek(in, 0, SEEK_CUR)) >= 0) {
+        if (begin >= st.st_size) return IO_OK;
+        if (what == COUNT_BYTES) {
+            counts->bytes += st.st_size - begin;
+            lseek(in, st.st_size, SEEK_SET);
+            return IO_OK;
+        }
+        char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, in, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            count_block(map + begin, map + st.st_size, counts, what, &in_word);
+            munmap(map, st.st_size);
+            lseek(in, st.st_size, SEEK_SET);
+            return IO_OK;
+        }
+    }
+
+    char buff[IO_BLOCK];
+    while (true) {
+        ssize_t n = read(in, buff, sizeof(buff));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return IO_READ_FAILED;
+        if (n == 0) return IO_OK;
+        count_block(buff, buff + n, counts, what, &in_word);
+    }
+}
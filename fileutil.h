@@ -0,0 +1,38 @@
+#ifndef FILEUTIL_H
+#define FILEUTIL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// The work behind the cat, head, tail and wc builtins, done on fds only so
+// that it can run on a thread of its own in a pipeline. Data is moved by the
+// kernel where it can be: copy_file_range() between files, splice() to and
+// from pipes and sendfile() from a file to anything else.
+
+typedef enum io_result_e {
+    IO_OK,
+    IO_READ_FAILED,
+    IO_WRITE_FAILED,
+} io_result_t;
+
+enum {
+    COUNT_LINES = 1 << 0,
+    COUNT_WORDS = 1 << 1,
+    COUNT_BYTES = 1 << 2,
+};
+
+typedef struct file_counts_s {
+    unsigned long long lines;
+    unsigned long long words;
+    unsigned long long bytes;
+} file_counts_t;
+
+bool fileutil_write(int out, const char *buff, size_t len);
+bool fileutil_same(int in, int out);
+io_result_t fileutil_copy(int in, int out);
+io_result_t fileutil_head(int in, int out, unsigned long long lines);
+io_result_t fileutil_tail(int in, int out, unsigned long long lines);
+io_result_t fileutil_skip(int in, int out, unsigned long long lines);
+io_result_t fileutil_count(int in, file_counts_t *counts, unsigned what);
+
+#endif // FILEUTIL_H
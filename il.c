@@ -7,6 +7,7 @@
 #include "il.h"
 #include "il_t.inc.h"
 #include "utils.h"
+#include "var.h"
 
 const char *io_redir_type_name(io_redir_type_t redir)
 {
@@ -36,85 +37,149 @@ const char *il_type_name(il_type_t type)
     _MKENT(COMPOSE_WORD);
     _MKENT(EXEC_BACKGROUND);
     _MKENT(EXEC_PIPELINE);
-    _MKENT(EXPAND_PARAM);
     _MKENT(PENDING_NOT);
     _MKENT(PIPELINE_LINK);
     _MKENT(PUSH_CMDINIT);
     _MKENT(PUSH_WORDINIT);
-    _MKENT(PUSH_NAME);
     _MKENT(PUSH_PARTIAL);
+    _MKENT(PUSH_WORD);
+    _MKENT(PUSH_ASSIGN);
     _MKENT(PUSH_FD);
     _MKENT(PUSH_REDIR);
+    _MKENT(PUSH_HOLE);
+    _MKENT(EXPAND_VAR);
+    _MKENT(JUMP_IF_FROZEN);
+    _MKENT(FREEZE_TEMPLATE);
+    _MKENT(COMPOSE_TEMPLATE);
     default: return "????????";
     }
 
 #undef _MKENT
 }
 
-static const int min_cap = 128;
+static const int min_cap = 512;
+static const int min_pool_cap = 256;
+static const int min_index_cap = 64;
 
 bool il_list_init(il_list_t *list)
 {
-    if (list == NULL || list->array != NULL) return false;
-    list->array = malloc(sizeof(il_t *) * min_cap);
-    if (list->array == NULL) return false;
+    if (list == NULL || list->code != NULL) return false;
+    memset(list, 0, sizeof(il_list_t));
+    list->code = malloc(min_cap);
+    list->pool = malloc(min_pool_cap);
+    list->pool_index = calloc(min_index_cap, sizeof(int32_t));
+    if (list->code == NULL || list->pool == NULL || list->pool_index == NULL) {
+        free(list->code);
+        free(list->pool);
+        free(list->pool_index);
+        list->code = NULL;
+        return false;
+    }
     list->capacity = min_cap;
-    list->size = 0;
+    list->pool_capacity = min_pool_cap;
+    list->pool_index_capacity = min_index_cap;
     return true;
 }
 
-void il_list_free(il_list_t *list)
+static void free_slots(il_list_t *list)
 {
-    if (list == NULL || list->array == NULL) return;
-    for (int i = 0; i < list->size; ++i) {
-        free(list->array[i]);
+    for (int i = 0; i < list->slot_count; ++i) {
+        if (list->slots[i] != NULL) list->slot_free(list->slots[i]);
     }
-    free(list->array);
-    list->array = NULL;
-    list->capacity = 0;
-    list->size = 0;
+    free(list->slots);
+    list->slots = NULL;
+    list->slot_count = 0;
+}
+
+void il_list_free(il_list_t *list)
+{
+    if (list == NULL || list->code == NULL) return;
+    free_slots(list);
+    free(list->code);
+    free(list->pool);
+    free(list->pool_index);
+    memset(list, 0, sizeof(il_list_t));
 }
 
 bool il_list_clear(il_list_t *list)
 {
-    if (list->capacity > min_cap) list->capacity = min_cap;
-    il_t **new_arr = realloc(list->array, list->capacity * sizeof(il_t *));
-    if (new_arr == NULL) return false;
-    list->array = new_arr;
+    if (!il_list_valid(list)) return false;
+    // Keep the buffers for the next command unless one was unusually large.
+    if (list->capacity > min_cap * 16 || list->pool_capacity > min_pool_cap * 16
+            || list->pool_index_capacity > min_index_cap * 16) {
+        il_list_free(list);
+        return il_list_init(list);
+    }
+    free_slots(list);
     list->size = 0;
+    list->count = 0;
+    list->pool_size = 0;
+    list->pool_count = 0;
+    list->template_count = 0;
+    memset(list->pool_index, 0, sizeof(int32_t) * list->pool_index_capacity);
     return true;
 }
 
-bool il_list_valid(const il_list_t *list)
+// `dest` must be zero-initialized or freed.
+bool il_list_copy(il_list_t *dest, const il_list_t *src)
 {
-    return list != NULL && list->array != NULL
-            && list->capacity >= min_cap && list->size >= 0;
+    if (!il_list_valid(src) || dest == NULL || dest->code != NULL) return false;
+    *dest = *src;
+    dest->slots = NULL;
+    dest->slot_count = 0;
+    dest->code = malloc(src->capacity);
+    dest->pool = malloc(src->pool_capacity);
+    dest->pool_index = malloc(sizeof(int32_t) * src->pool_index_capacity);
+    if (dest->code == NULL || dest->pool == NULL || dest->pool_index == NULL) {
+        free(dest->code);
+        free(dest->pool);
+        free(dest->pool_index);
+        memset(dest, 0, sizeof(il_list_t));
+        return false;
+    }
+    memcpy(dest->code, src->code, src->size);
+    memcpy(dest->pool, src->pool, src->pool_size);
+    memcpy(dest->pool_index, src->pool_index, sizeof(int32_t) * src->pool_index_capacity);
+    return true;
 }
 
-int il_list_size(const il_list_t *list)
+// Returns the run time slot for template `slot`, which is freed with
+// `free_fn` along with the list. Returns NULL if out of memory.
+void **il_list_slot(il_list_t *list, int slot, void (*free_fn)(void *))
 {
-    if (list == NULL || list->array == NULL) return 0;
-    return list->size;
+    if (!il_list_valid(list) || slot < 0 || slot >= list->template_count) return NULL;
+    if (list->slots == NULL) {
+        list->slots = calloc(list->template_count, sizeof(void *));
+        if (list->slots == NULL) return NULL;
+        list->slot_count = list->template_count;
+    }
+    list->slot_free = free_fn;
+    return &list->slots[slot];
 }
 
-static bool try_expand_list(il_list_t *list)
+bool il_list_valid(const il_list_t *list)
 {
-    if (list->size + 1 < list->capacity) return true;
-    int new_cap = list->capacity * 2;
-    if (new_cap < 0) return false;
-    il_t **new_arr = realloc(list->array, list->capacity);
-    if (new_arr == NULL) return false;
-    list->capacity = new_cap;
-    list->array = new_arr;
-    return true;
+    return list != NULL && list->code != NULL && list->size >= 0;
 }
 
-static bool il_list_raw_push(il_list_t *list, il_t *il)
+int il_list_size(const il_list_t *list)
 {
-    if (il == NULL) return false;
-    if (!try_expand_list(list)) return false;
+    if (!il_list_valid(list)) return 0;
+    return list->count;
+}
 
-    list->array[list->size++] = il;
+static bool try_grow(void **buff, int *capacity, int needed, size_t elem_size)
+{
+    if (needed <= *capacity) return true;
+    int new_cap = *capacity;
+    while (new_cap < needed) {
+        if (new_cap > INT_MAX / 2) return false;
+        new_cap *= 2;
+    }
+    void *new_buff = realloc(*buff, elem_size * new_cap);
+    if (new_buff == NULL) return false;
+    *buff = new_buff;
+    *capacity = new_cap;
     return true;
 }
 
@@ -134,86 +199,135 @@ static il_type_type_t get_il_type_type(il_type_t type)
     case IL_COMPOSE_WORD:
     case IL_EXEC_BACKGROUND:
     case IL_EXEC_PIPELINE:
-    case IL_EXPAND_PARAM:
     case IL_PENDING_NOT:
     case IL_PIPELINE_LINK:
     case IL_PUSH_CMDINIT:
     case IL_PUSH_WORDINIT:
         return IL_TYPE_NO_PARAM;
-    case IL_PUSH_NAME:
     case IL_PUSH_PARTIAL:
+    case IL_PUSH_WORD:
+    case IL_PUSH_ASSIGN:
         return IL_TYPE_STR_PARAM;
     case IL_PUSH_FD:
     case IL_PUSH_REDIR:
+    case IL_PUSH_HOLE:
+    case IL_EXPAND_VAR:
+    case IL_JUMP_IF_FROZEN:
+    case IL_FREEZE_TEMPLATE:
+    case IL_COMPOSE_TEMPLATE:
         return IL_TYPE_INT_PARAM;
     default:
         return IL_TYPE_INVALID;
     }
 }
 
-bool il_list_push(il_list_t *list, il_type_t type)
+int il_length(il_type_t type)
 {
-    if (!il_list_valid(list) || get_il_type_type(type) != IL_TYPE_NO_PARAM) return false;
+    return (get_il_type_type(type) == IL_TYPE_NO_PARAM) ? 1 : 1 + (int)sizeof(int32_t);
+}
 
-    il_t *il = malloc(sizeof(il_t));
-    if (il == NULL) return false;
-    il->type = type;
-    if (!il_list_raw_push(list, il)) {
-        free(il);
-        return false;
+static bool il_list_emit(il_list_t *list, il_type_t type, int32_t operand)
+{
+    int len = il_length(type);
+    if (list->size > INT_MAX - len) return false;
+    if (!try_grow((void **)&list->code, &list->capacity, list->size + len, 1)) return false;
+    list->code[list->size] = (uint8_t)type;
+    if (len > 1) memcpy(list->code + list->size + 1, &operand, sizeof(operand));
+    list->size += len;
+    ++list->count;
+    return true;
+}
+
+static bool pool_rehash(il_list_t *list)
+{
+    int new_cap = list->pool_index_capacity * 2;
+    if (new_cap <= 0) return false;
+    int32_t *new_index = calloc(new_cap, sizeof(int32_t));
+    if (new_index == NULL) return false;
+    for (int i = 0; i < list->pool_index_capacity; ++i) {
+        int32_t entry = list->pool_index[i];
+        if (entry == 0) continue;
+        const char *str = list->pool + entry - 1;
+        uint32_t slot = str_hash(str, strlen(str)) & (new_cap - 1);
+        while (new_index[slot] != 0) slot = (slot + 1) & (new_cap - 1);
+        new_index[slot] = entry;
     }
+    free(list->pool_index);
+    list->pool_index = new_index;
+    list->pool_index_capacity = new_cap;
     return true;
 }
 
-bool il_list_pushs(il_list_t *list, il_type_t type, const char *payload)
+// Returns the offset of `str` in the pool, adding it if it isn't there yet.
+int32_t il_list_intern(il_list_t *list, const char *str, size_t len)
 {
-    if (!il_list_valid(list) || payload == NULL || get_il_type_type(type) != IL_TYPE_STR_PARAM) return false;
-    size_t pl_len = strlen(payload);
-    if (pl_len >= PTRDIFF_MAX) return false;
+    if (len >= INT_MAX - (size_t)list->pool_size - 1) return -1;
+    if ((list->pool_count + 1) * 2 > list->pool_index_capacity && !pool_rehash(list)) return -1;
 
-    il_param_str_t *il = malloc(sizeof(il_param_str_t) + pl_len + 1);
-    if (il == NULL) return false;
-    il->type = type;
+    int mask = list->pool_index_capacity - 1;
+    uint32_t slot = str_hash(str, len) & mask;
+    for (; list->pool_index[slot] != 0; slot = (slot + 1) & mask) {
+        const char *entry = list->pool + list->pool_index[slot] - 1;
+        if (strncmp(entry, str, len) == 0 && entry[len] == '\0') {
+            return list->pool_index[slot] - 1;
+        }
+    }
 
-    memcpy(il->pl_str, payload, pl_len);
-    il->pl_str[pl_len] = '\0';
+    int needed = list->pool_size + (int)len + 1;
+    if (!try_grow((void **)&list->pool, &list->pool_capacity, needed, 1)) return -1;
+    int32_t offset = list->pool_size;
+    memcpy(list->pool + offset, str, len);
+    list->pool[offset + len] = '\0';
+    list->pool_size = needed;
+    list->pool_index[slot] = offset + 1;
+    ++list->pool_count;
+    return offset;
+}
 
-    if (!il_list_raw_push(list, (il_t *)il)) {
-        free(il);
-        return false;
-    }
-    return true;
+bool il_list_push(il_list_t *list, il_type_t type)
+{
+    if (!il_list_valid(list) || get_il_type_type(type) != IL_TYPE_NO_PARAM) return false;
+    return il_list_emit(list, type, 0);
+}
+
+bool il_list_pushs(il_list_t *list, il_type_t type, const char *payload)
+{
+    if (payload == NULL) return false;
+    return il_list_pushsn(list, type, payload, strlen(payload));
+}
+
+// Pushes a payload that need not be NUL-terminated, e.g. a token span.
+bool il_list_pushsn(il_list_t *list, il_type_t type, const char *payload, size_t len)
+{
+    if (!il_list_valid(list) || payload == NULL || get_il_type_type(type) != IL_TYPE_STR_PARAM) return false;
+    int32_t offset = il_list_intern(list, payload, len);
+    if (offset < 0) return false;
+    return il_list_emit(list, type, offset);
 }
 
 bool il_list_pushi(il_list_t *list, il_type_t type, int payload)
 {
     if (!il_list_valid(list) || get_il_type_type(type) != IL_TYPE_INT_PARAM) return false;
-
-    il_param_int_t *il = malloc(sizeof(il_param_int_t));
-    if (il == NULL) return false;
-    il->type = type;
-    il->pl_int = payload;
-    if (!il_list_raw_push(list, (il_t *)il)) {
-        free(il);
-        return false;
-    }
-    return true;
+    return il_list_emit(list, type, payload);
 }
 
-void print_il(il_t *il)
+void print_il(const il_list_t *list, int pc)
 {
-    printf("%-16s", il_type_name(il->type));
-    switch (get_il_type_type(il->type)) {
+    il_type_t type = il_at(list, pc);
+    printf("%-16s", il_type_name(type));
+    switch (get_il_type_type(type)) {
     case IL_TYPE_NO_PARAM:
         printf("\n");
         break;
     case IL_TYPE_STR_PARAM:
         putchar(' ');
-        print_str_repr(((il_param_str_t *)il)->pl_str, -1);
+        print_str_repr(il_str_at(list, pc), -1);
         putchar('\n');
         break;
     case IL_TYPE_INT_PARAM:
-        printf(" %d\n", ((il_param_int_t *)il)->pl_int);
+        printf(" %d", il_int_at(list, pc));
+        if (type == IL_EXPAND_VAR) printf(" (%s)", var_name(il_int_at(list, pc)));
+        putchar('\n');
         break;
     default:
         break;
@@ -227,10 +341,9 @@ void il_list_dump(const il_list_t *list)
         return;
     }
     printf("<<<<<======= IL DUMP BEGIN OF %p =======<<<<<\n", list);
-    for (int i = 0; i < list->size; ++i) {
-        il_t *il = list->array[i];
+    for (int pc = 0; pc < list->size; pc += il_length(il_at(list, pc))) {
         printf("    ");
-        print_il(il);
+        print_il(list, pc);
     }
     printf(">>>>>======== IL DUMP END OF %p ========>>>>>\n", list);
 }
@@ -1,6 +1,7 @@
 #ifndef IL_H
 #define IL_H
 
+#include <stddef.h>
 #include <stdbool.h>
 
 typedef enum io_redir_type_e {
@@ -23,21 +24,35 @@ typedef enum il_type_e {
     IL_COMPOSE_WORD,     // Make an complete word till first WORDINIT
     IL_EXEC_BACKGROUND,  // Execute the pipeline in the background
     IL_EXEC_PIPELINE,    // Execute a pipeline
-    IL_EXPAND_PARAM,     // Do parameter expansion
     IL_PENDING_NOT,      // Inverse next EXEC_*'s result
     IL_PIPELINE_LINK,    // Create a pipeline between two commands
     IL_PUSH_CMDINIT,     // Push a CMDINIT to the stack
     IL_PUSH_WORDINIT,    // Push a WORDINIT to the stack
 
     // 1 string parameter
-    IL_PUSH_NAME,        // Push a name to the stack
     IL_PUSH_PARTIAL,     // Push a partial word to the stack
+    IL_PUSH_WORD,        // Push a complete word, i.e. WORDINIT PARTIAL... COMPOSE_WORD
+    IL_PUSH_ASSIGN,      // Push an assignment word, i.e. PUSH_WORD ASSIGN_WORD
 
     // 1 integer parameter
     IL_PUSH_FD,          // Push a file descriptor to the stack
     IL_PUSH_REDIR,     // Push IO-redir type to the stack
+    IL_PUSH_HOLE,        // Push a hole for the dynamic part of a template
+    IL_EXPAND_VAR,       // Push the value of a variable, by slot (see var.h), as a partial word
+    IL_JUMP_IF_FROZEN,   // Skip the bytes given if the next template is frozen
+    IL_FREEZE_TEMPLATE,  // Make a command template till first CMDINIT
+    IL_COMPOSE_TEMPLATE, // Make a command from a template and its dynamic parts
+
+    IL_TYPE_COUNT,       // Number of IL types, not an IL
 } il_type_t;
 
+// Which part of a command a template hole stands for
+typedef enum il_hole_e {
+    IL_HOLE_ARG,
+    IL_HOLE_ASSIGN,
+    IL_HOLE_REDIR,
+} il_hole_t;
+
 typedef struct il_list_s il_list_t;
 
 const char *io_redir_type_name(io_redir_type_t redir);
@@ -46,11 +61,15 @@ const char *il_type_name(il_type_t type);
 bool il_list_init(il_list_t *list);
 void il_list_free(il_list_t *list);
 bool il_list_clear(il_list_t *list);
+bool il_list_copy(il_list_t *dest, const il_list_t *src);
 bool il_list_valid(const il_list_t * list);
 int il_list_size(const il_list_t * list);
 bool il_list_push(il_list_t *list, il_type_t type);
 bool il_list_pushs(il_list_t *list, il_type_t type, const char *payload);
+bool il_list_pushsn(il_list_t *list, il_type_t type, const char *payload, size_t len);
 bool il_list_pushi(il_list_t *list, il_type_t type, int payload);
+bool il_list_optimize(il_list_t *list);
 void il_list_dump(const il_list_t *list);
+void **il_list_slot(il_list_t *list, int slot, void (*free_fn)(void *));
 
 #endif // IL_H
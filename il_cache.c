@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "il.h"
+#include "il_t.inc.h"
+#include "il_cache.h"
+#include "alias.h"
+#include "utils.h"
+#include "cfuhash.h"
+
+// Maps a command line to the IL compiled from it, so that running the same
+// line again skips the lexer and the parser. Alias expansion happens in the
+// lexer, so the whole cache is dropped whenever an alias changes.
+
+static const size_t IL_CACHE_MAX_ENTRIES = 512;
+
+static cfuhash_table_t *il_cache = NULL;
+static unsigned il_cache_alias_gen = 0;
+static unsigned long il_cache_hits = 0;
+static unsigned long il_cache_misses = 0;
+
+static void il_cache_free_entry(void *data)
+{
+    il_list_free((il_list_t *)data);
+    free(data);
+}
+
+static void il_cache_delete(void)
+{
+    if (il_cache != NULL) cfuhash_destroy(il_cache);
+    il_cache = NULL;
+}
+
+static bool il_cache_init(void)
+{
+    if (il_cache != NULL) return true;
+    il_cache = cfuhash_new_with_free_fn(&il_cache_free_entry);
+    if (il_cache == NULL) return false;
+    cfuhash_set_flag(il_cache, CFUHASH_NO_LOCKING);
+    il_cache_alias_gen = alias_generation();
+    atexit(&il_cache_delete);
+    return true;
+}
+
+// Leading blanks and the newline ending the line don't change its meaning.
+static bool il_cache_key(const char **begin, const char **end)
+{
+    while (*begin < *end && (**begin == ' ' || **begin == '\t')) ++*begin;
+    if (*begin < *end && (*end)[-1] == '\n') --*end;
+    return *begin < *end;
+}
+
+static bool il_cache_valid(void)
+{
+    if (!il_cache_init()) return false;
+    if (il_cache_alias_gen != alias_generation()) {
+        cfuhash_clear(il_cache);
+        il_cache_alias_gen = alias_generation();
+    }
+    return true;
+}
+
+il_list_t *il_cache_get(const char *begin, const char *end)
+{
+    if (!il_cache_key(&begin, &end) || !il_cache_valid()) return NULL;
+
+    void *data = NULL;
+    if (cfuhash_get_data(il_cache, begin, end - begin, &data, NULL)) {
+        ++il_cache_hits;
+        return (il_list_t *)data;
+    }
+    ++il_cache_misses;
+    return NULL;
+}
+
+bool il_cache_put(const char *begin, const char *end, const il_list_t *list)
+{
+    if (!il_cache_key(&begin, &end) || !il_cache_valid()) return false;
+    if (cfuhash_exists_data(il_cache, begin, end - begin)) return true;
+    if (cfuhash_num_entries(il_cache) >= IL_CACHE_MAX_ENTRIES) {
+        cfuhash_clear(il_cache);
+    }
+
+    il_list_t *copy = malloc(sizeof(il_list_t));
+    if (copy == NULL) return false;
+    memset(copy, 0, sizeof(il_list_t));
+    if (!il_list_copy(copy, list)) {
+        free(copy);
+        return false;
+    }
+    cfuhash_put_data(il_cache, begin, end - begin, copy, sizeof(il_list_t), NULL);
+    return true;
+}
+
+void il_cache_print_stats(void)
+{
+    printf("il cache: %lu hits, %lu misses, %lu entries\n", il_cache_hits,
+           il_cache_misses, (unsigned long)(il_cache ? cfuhash_num_entries(il_cache) : 0));
+}
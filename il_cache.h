@@ -0,0 +1,11 @@
+#ifndef IL_CACHE_H
+#define IL_CACHE_H
+
+#include <stdbool.h>
+#include "il.h"
+
+il_list_t *il_cache_get(const char *begin, const char *end);
+bool il_cache_put(const char *begin, const char *end, const il_list_t *list);
+void il_cache_print_stats(void);
+
+#endif // IL_CACHE_H
@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "il.h"
+#include "il_t.inc.h"
+#include "utils.h"
+
+// A peephole pass over IL lists, run once after parsing. It rewrites the
+// list in place; no IL sequence it matches is shorter than what it emits.
+//
+//   PUSH_WORDINIT PUSH_PARTIAL... COMPOSE_WORD ASSIGN_WORD -> PUSH_ASSIGN
+//   PUSH_WORDINIT PUSH_PARTIAL... COMPOSE_WORD             -> PUSH_WORD
+//   PUSH_PARTIAL PUSH_PARTIAL...                           -> PUSH_PARTIAL
+//
+// Quote removal and tilde expansion of fused words are done here instead of
+// in vm_compose_word(). Words with parameter expansions are left to the VM,
+// but runs of their partials are still merged where quote removal allows.
+//
+// Then every simple command is turned into a template:
+//
+//   PUSH_CMDINIT parts... COMPOSE_COMMAND
+//
+// becomes
+//
+//   JUMP_IF_FROZEN (to D)
+//   PUSH_CMDINIT static parts, with PUSH_HOLE for each dynamic one
+//   FREEZE_TEMPLATE slot
+//   D: dynamic parts... COMPOSE_TEMPLATE slot
+//
+// so the static parts are built once, and later runs only compute the
+// dynamic parts and drop them into the holes.
+
+typedef struct str_buf_s {
+    char *str;
+    size_t size;
+    size_t capacity;
+} str_buf_t;
+
+static bool str_buf_reserve(str_buf_t *buf, size_t extra)
+{
+    if (buf->size + extra + 1 <= buf->capacity) return true;
+    size_t new_cap = buf->capacity == 0 ? 64 : buf->capacity;
+    while (new_cap < buf->size + extra + 1) new_cap *= 2;
+    char *new_str = realloc(buf->str, new_cap);
+    if (new_str == NULL) return false;
+    buf->str = new_str;
+    buf->capacity = new_cap;
+    return true;
+}
+
+// Whether quote removal of `str` ends outside quotes and escapes, so that it
+// can be joined with the next partial without changing the result.
+static bool ends_unquoted(const char *str)
+{
+    bool single_quote = false, backslash = false;
+    for (const char *p = str; *p != '\0'; ++p) {
+        if (*p == '\'' && (single_quote || !backslash)) {
+            single_quote = !single_quote;
+        } else if (*p == '\\' && single_quote == false && backslash == false) {
+            if (p[1] == '\n') ++p;  // line continuation
+            else backslash = true;
+        } else {
+            backslash = false;
+        }
+    }
+    return !single_quote && !backslash;
+}
+
+static void emit(il_list_t *list, int *out, il_type_t type, int32_t operand)
+{
+    list->code[*out] = (uint8_t)type;
+    if (il_length(type) > 1) memcpy(list->code + *out + 1, &operand, sizeof(operand));
+    *out += il_length(type);
+    ++list->count;
+}
+
+static void copy_il(il_list_t *list, int *out, int pc)
+{
+    int len = il_length(il_at(list, pc));
+    memmove(list->code + *out, list->code + pc, len);
+    *out += len;
+    ++list->count;
+}
+
+static int skip_partials(const il_list_t *list, int pc)
+{
+    while (pc < list->size && il_at(list, pc) == IL_PUSH_PARTIAL) {
+        pc += il_length(IL_PUSH_PARTIAL);
+    }
+    return pc;
+}
+
+// Fuses a literal word starting at the PUSH_WORDINIT at `pc`. Returns the pc
+// after the fused ILs, or `pc` if the word can't be fused.
+static int fuse_word(il_list_t *list, int *out, int pc, str_buf_t *buf)
+{
+    int first = pc + il_length(IL_PUSH_WORDINIT);
+    int end = skip_partials(list, first);
+    if (end == first || end >= list->size || il_at(list, end) != IL_COMPOSE_WORD) return pc;
+    int next = end + il_length(IL_COMPOSE_WORD);
+    bool assign = next < list->size && il_at(list, next) == IL_ASSIGN_WORD;
+
+    buf->size = 0;
+    for (int i = first; i < end; i += il_length(IL_PUSH_PARTIAL)) {
+        const char *partial = il_str_at(list, i);
+        size_t len = strlen(partial);
+        if (!str_buf_reserve(buf, len)) return pc;
+        buf->size = remove_quotes(buf->str + buf->size, partial, len) - buf->str;
+    }
+
+    if (il_str_at(list, first)[0] == '~') {
+        char *path = tilde_expand(buf->str);
+        if (path != NULL) {
+            size_t len = strlen(path);
+            buf->size = 0;
+            if (!str_buf_reserve(buf, len)) {
+                free(path);
+                return pc;
+            }
+            memcpy(buf->str, path, len + 1);
+            buf->size = len;
+            free(path);
+        }
+    }
+
+    // Let the VM report assignments without '='
+    if (assign && strchr(buf->str, '=') == NULL) assign = false;
+
+    int32_t offset = il_list_intern(list, buf->str, buf->size);
+    if (offset < 0) return pc;
+    if (assign) {
+        emit(list, out, IL_PUSH_ASSIGN, offset);
+        return next + il_length(IL_ASSIGN_WORD);
+    }
+    emit(list, out, IL_PUSH_WORD, offset);
+    return next;
+}
+
+// Merges the run of partials starting at `pc`. Returns the pc after the ILs
+// consumed.
+static int merge_partials(il_list_t *list, int *out, int pc, str_buf_t *buf)
+{
+    int step = il_length(IL_PUSH_PARTIAL);
+    int end = pc + step;
+    buf->size = 0;
+    const char *partial = il_str_at(list, pc);
+    while (end < list->size && il_at(list, end) == IL_PUSH_PARTIAL && ends_unquoted(partial)) {
+        if (buf->size == 0) {
+            size_t len = strlen(partial);
+            if (!str_buf_reserve(buf, len)) break;
+            memcpy(buf->str, partial, len + 1);
+            buf->size = len;
+        }
+        partial = il_str_at(list, end);
+        size_t len = strlen(partial);
+        if (!str_buf_reserve(buf, len)) break;
+        memcpy(buf->str + buf->size, partial, len + 1);
+        buf->size += len;
+        end += step;
+    }
+
+    int32_t offset;
+    if (buf->size == 0 || (offset = il_list_intern(list, buf->str, buf->size)) < 0) {
+        copy_il(list, out, pc);
+        return pc + step;
+    }
+    emit(list, out, IL_PUSH_PARTIAL, offset);
+    return end;
+}
+
+static bool str_buf_append(str_buf_t *buf, const void *data, size_t len)
+{
+    if (!str_buf_reserve(buf, len)) return false;
+    memcpy(buf->str + buf->size, data, len);
+    buf->size += len;
+    return true;
+}
+
+static bool str_buf_append_il(str_buf_t *buf, il_type_t type, int32_t operand)
+{
+    uint8_t op = (uint8_t)type;
+    if (!str_buf_append(buf, &op, 1)) return false;
+    if (il_length(type) == 1) return true;
+    return str_buf_append(buf, &operand, sizeof(operand));
+}
+
+typedef struct command_part_s {
+    int begin;
+    int end;
+    bool dynamic;
+    il_hole_t hole;
+} command_part_t;
+
+static bool expect_il(const il_list_t *list, int *pc, il_type_t type)
+{
+    if (*pc >= list->size || il_at(list, *pc) != type) return false;
+    *pc += il_length(type);
+    return true;
+}
+
+// Reads one argument, assignment or redirection starting at `pc`.
+static bool read_command_part(const il_list_t *list, int pc, command_part_t *part)
+{
+    part->begin = pc;
+    part->dynamic = false;
+    part->hole = IL_HOLE_ARG;
+
+    switch (il_at(list, pc)) {
+    case IL_PUSH_FD:  // n>&m
+        part->hole = IL_HOLE_REDIR;
+        part->end = pc + il_length(IL_PUSH_FD);
+        return expect_il(list, &part->end, IL_PUSH_FD)
+                && expect_il(list, &part->end, IL_PUSH_REDIR)
+                && expect_il(list, &part->end, IL_COMPOSE_IOREDIR);
+    case IL_PUSH_ASSIGN:
+        part->hole = IL_HOLE_ASSIGN;
+        part->end = pc + il_length(IL_PUSH_ASSIGN);
+        return true;
+    case IL_PUSH_WORD:
+        pc += il_length(IL_PUSH_WORD);
+        break;
+    case IL_PUSH_WORDINIT:
+        part->dynamic = true;
+        pc += il_length(IL_PUSH_WORDINIT);
+        while (pc < list->size && il_at(list, pc) != IL_COMPOSE_WORD) {
+            il_type_t type = il_at(list, pc);
+            if (type != IL_PUSH_PARTIAL && type != IL_EXPAND_VAR) return false;
+            pc += il_length(type);
+        }
+        if (!expect_il(list, &pc, IL_COMPOSE_WORD)) return false;
+        if (expect_il(list, &pc, IL_ASSIGN_WORD)) {
+            part->hole = IL_HOLE_ASSIGN;
+            part->end = pc;
+            return true;
+        }
+        break;
+    default:
+        return false;
+    }
+
+    // A word followed by a redirection is its path
+    if (pc < list->size && il_at(list, pc) == IL_PUSH_FD) {
+        part->hole = IL_HOLE_REDIR;
+        pc += il_length(IL_PUSH_FD);
+        if (!expect_il(list, &pc, IL_PUSH_REDIR) || !expect_il(list, &pc, IL_COMPOSE_IOREDIR)) return false;
+    }
+    part->end = pc;
+    return true;
+}
+
+// Emits the command starting at the PUSH_CMDINIT at `pc` as a template.
+// Returns the pc after the command, or `pc` if it can't be templated.
+static int template_command(il_list_t *list, str_buf_t *out, int pc, command_part_t **parts, int *parts_cap)
+{
+    int part_count = 0;
+    int end = pc + il_length(IL_PUSH_CMDINIT);
+    while (end < list->size && il_at(list, end) != IL_COMPOSE_COMMAND) {
+        if (part_count == *parts_cap) {
+            int new_cap = *parts_cap == 0 ? 8 : *parts_cap * 2;
+            command_part_t *new_parts = realloc(*parts, sizeof(command_part_t) * new_cap);
+            if (new_parts == NULL) return pc;
+            *parts = new_parts;
+            *parts_cap = new_cap;
+        }
+        command_part_t *part = &(*parts)[part_count];
+        if (!read_command_part(list, end, part)) return pc;
+        end = part->end;
+        ++part_count;
+    }
+    if (end >= list->size) return pc;
+    end += il_length(IL_COMPOSE_COMMAND);
+
+    int jump_len = il_length(IL_JUMP_IF_FROZEN);
+    int static_len = il_length(IL_PUSH_CMDINIT) + il_length(IL_FREEZE_TEMPLATE);
+    for (int i = 0; i < part_count; ++i) {
+        command_part_t *part = &(*parts)[i];
+        static_len += part->dynamic ? il_length(IL_PUSH_HOLE) : part->end - part->begin;
+    }
+
+    size_t saved_size = out->size;
+    int slot = list->template_count;
+    bool ok = str_buf_append_il(out, IL_JUMP_IF_FROZEN, jump_len + static_len)
+            && str_buf_append_il(out, IL_PUSH_CMDINIT, 0);
+    for (int i = 0; ok && i < part_count; ++i) {
+        command_part_t *part = &(*parts)[i];
+        if (part->dynamic) {
+            ok = str_buf_append_il(out, IL_PUSH_HOLE, part->hole);
+        } else {
+            ok = str_buf_append(out, list->code + part->begin, part->end - part->begin);
+        }
+    }
+    ok = ok && str_buf_append_il(out, IL_FREEZE_TEMPLATE, slot);
+    for (int i = 0; ok && i < part_count; ++i) {
+        command_part_t *part = &(*parts)[i];
+        if (part->dynamic) ok = str_buf_append(out, list->code + part->begin, part->end - part->begin);
+    }
+    ok = ok && str_buf_append_il(out, IL_COMPOSE_TEMPLATE, slot);
+    if (!ok) {
+        out->size = saved_size;
+        return pc;
+    }
+    ++list->template_count;
+    return end;
+}
+
+static bool compile_templates(il_list_t *list)
+{
+    str_buf_t out = { NULL, 0, 0 };
+    command_part_t *parts = NULL;
+    int parts_cap = 0;
+    int pc = 0;
+    while (pc < list->size) {
+        int next = pc;
+        if (il_at(list, pc) == IL_PUSH_CMDINIT) {
+            next = template_command(list, &out, pc, &parts, &parts_cap);
+        }
+        if (next == pc) {
+            next = pc + il_length(il_at(list, pc));
+            if (!str_buf_append(&out, list->code + pc, next - pc)) {
+                free(parts);
+                free(out.str);
+                return false;
+            }
+        }
+        pc = next;
+    }
+    free(parts);
+    if (out.str == NULL) return true;
+
+    int count = 0;
+    for (size_t i = 0; i < out.size; i += il_length((uint8_t)out.str[i])) ++count;
+    free(list->code);
+    list->code = (uint8_t *)out.str;
+    list->size = (int)out.size;
+    list->capacity = (int)out.capacity;
+    list->count = count;
+    return true;
+}
+
+bool il_list_optimize(il_list_t *list)
+{
+    if (!il_list_valid(list)) return false;
+    str_buf_t buf = { NULL, 0, 0 };
+    int out = 0;
+    int pc = 0;
+    list->count = 0;
+    while (pc < list->size) {
+        int next = pc;
+        switch (il_at(list, pc)) {
+        case IL_PUSH_WORDINIT:
+            next = fuse_word(list, &out, pc, &buf);
+            break;
+        case IL_PUSH_PARTIAL:
+            next = merge_partials(list, &out, pc, &buf);
+            break;
+        default:
+            break;
+        }
+        if (next == pc) {
+            next = pc + il_length(il_at(list, pc));
+            copy_il(list, &out, pc);
+        }
+        pc = next;
+    }
+    list->size = out;
+    free(buf.str);
+    return compile_templates(list);
+}
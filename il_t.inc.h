@@ -1,28 +1,54 @@
 #ifndef IL_T_INC_H
 #define IL_T_INC_H
 
+#include <stdint.h>
+#include <string.h>
 #include "il.h"
 
-typedef struct il_s {
-    il_type_t type;
-} il_t;
-
-typedef struct il_param_int_s {
-    il_type_t type;
-    int pl_int;
-} il_param_int_t;
-
-typedef struct il_param_str_s {
-    il_type_t type;
-    char pl_str[];
-} il_param_str_t;
-
+// ILs are encoded as a flat byte code: one byte of opcode, followed by a
+// 32-bit operand for ILs taking a parameter. String parameters are stored as
+// offsets into a pool of NUL-terminated strings, each stored once. Neither
+// part contains pointers, so a list can be copied or saved with plain memcpy.
 typedef struct il_list_s {
-    il_t **array;
-    int size;
+    uint8_t *code;
+    int size;           // bytes of code in use
     int capacity;
+    int count;          // number of ILs
+    char *pool;
+    int pool_size;
+    int pool_capacity;
+    int32_t *pool_index;  // hash set of pool offsets + 1, to deduplicate
+    int pool_index_capacity;
+    int pool_count;
+    int template_count;  // command templates compiled into the code
+
+    // Run time state, not part of the encoding: templates frozen by the VM,
+    // indexed by the operand of FREEZE_TEMPLATE.
+    void **slots;
+    int slot_count;
+    void (*slot_free)(void *);
 } il_list_t;
 
-void print_il(il_t *il);
+int il_length(il_type_t type);
+int32_t il_list_intern(il_list_t *list, const char *str, size_t len);
+
+static inline il_type_t il_at(const il_list_t *list, int pc)
+{
+    return (il_type_t)list->code[pc];
+}
+
+static inline int il_int_at(const il_list_t *list, int pc)
+{
+    int32_t operand;
+    memcpy(&operand, list->code + pc + 1, sizeof(operand));
+    return operand;
+}
+
+static inline const char *il_str_at(const il_list_t *list, int pc)
+{
+    return list->pool + il_int_at(list, pc);
+}
+
+void print_il(const il_list_t *list, int pc);
 
 #endif // IL_T_INC_H
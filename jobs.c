@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+#include <sys/signalfd.h>
+#include "jobs.h"
+#include "utils.h"
+#include "var.h"
+
+// With job control, which interactive shells have, every job runs in its own
+// process group and a foreground job gets the terminal while it runs. Keys
+// like ^C then signal the job and not the shell.
+//
+// Background jobs are kept in a table, numbered from 1 and reused from the
+// lowest free number. SIGCHLD is blocked and read from a signalfd instead, so
+// finished children are reaped whenever that fd turns readable: while waiting
+// for input, before each command and in `wait`.
+
+static bool job_control = false;
+static pid_t shell_pgid = 0;
+static int sigchld_fd = -1;
+
+static job_t **table = NULL;
+static int table_size = 0;
+static int last_job = 0;  // the most recently started, %% and %+
+
+// Ignored by the shell so that it can hand the terminal around, and put back
+// to default in every command started
+static const int job_signals[] = { SIGTSTP, SIGTTIN, SIGTTOU };
+
+void jobs_init(void)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0) panic("nsh: sigprocmask");
+    sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigchld_fd < 0) panic("nsh: signalfd");
+}
+
+void jobs_init_control(void)
+{
+    if (!isatty(STDIN_FILENO)) return;
+    shell_pgid = getpgrp();
+    if (tcgetpgrp(STDIN_FILENO) != shell_pgid) return;
+    for (size_t i = 0; i < sizeof(job_signals) / sizeof(job_signals[0]); ++i) {
+        signal(job_signals[i], SIG_IGN);
+    }
+    job_control = true;
+}
+
+bool jobs_control(void)
+{
+    return job_control;
+}
+
+// Readable when a child may have finished, see jobs_reap()
+int jobs_fd(void)
+{
+    return sigchld_fd;
+}
+
+job_t *job_new(int count)
+{
+    job_t *job = malloc(sizeof(job_t));
+    if (job == NULL) return NULL;
+    job->id = 0;
+    job->pgid = 0;
+    job->count = count;
+    job->running = 0;
+    job->text = NULL;
+    job->pids = malloc(sizeof(pid_t) * count);
+    job->statuses = malloc(sizeof(int) * count);
+    if (job->pids == NULL || job->statuses == NULL) {
+        job_free(job);
+        return NULL;
+    }
+    for (int i = 0; i < count; ++i) {
+        job->pids[i] = -1;
+        job->statuses[i] = EXIT_FAILURE;
+    }
+    return job;
+}
+
+void job_free(job_t *job)
+{
+    if (job == NULL) return;
+    free(job->pids);
+    free(job->statuses);
+    free(job->text);
+    free(job);
+}
+
+// Sets up `attr` for starting the next stage of `job`. The caller destroys it.
+bool job_spawnattr(job_t *job, posix_spawnattr_t *attr)
+{
+    if (posix_spawnattr_init(attr) != 0) return false;
+    // Commands mustn't inherit the blocked SIGCHLD
+    sigset_t none;
+    sigemptyset(&none);
+    short flags = POSIX_SPAWN_SETSIGMASK;
+    if (posix_spawnattr_setsigmask(attr, &none) != 0) {
+        posix_spawnattr_destroy(attr);
+        return false;
+    }
+    if (job_control) {
+        sigset_t defaults;
+        sigemptyset(&defaults);
+        for (size_t i = 0; i < sizeof(job_signals) / sizeof(job_signals[0]); ++i) {
+            sigaddset(&defaults, job_signals[i]);
+        }
+        flags |= POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP;
+        if (posix_spawnattr_setsigdefault(attr, &defaults) != 0
+                || posix_spawnattr_setpgroup(attr, job->pgid) != 0) {
+            posix_spawnattr_destroy(attr);
+            return false;
+        }
+    }
+    if (posix_spawnattr_setflags(attr, flags) != 0) {
+        posix_spawnattr_destroy(attr);
+        return false;
+    }
+    return true;
+}
+
+void job_started(job_t *job, int stage, pid_t pid)
+{
+    job->pids[stage] = pid;
+    ++job->running;
+    if (!job_control) return;
+    if (job->pgid == 0) job->pgid = pid;
+    // Already done by a spawned child, not yet maybe by a forked one
+    setpgid(pid, job->pgid);
+}
+
+// Sets up a forked child, which is about to run a stage of `job` itself,
+// the way job_spawnattr() does for spawned ones.
+void job_enter_child(job_t *job)
+{
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+    if (!job_control) return;
+    setpgid(0, job->pgid);
+    for (size_t i = 0; i < sizeof(job_signals) / sizeof(job_signals[0]); ++i) {
+        signal(job_signals[i], SIG_DFL);
+    }
+}
+
+// For a stage that ended without a process of its own: it couldn't be
+// started, or was a builtin run by the shell.
+void job_finished(job_t *job, int stage, int status)
+{
+    job->pids[stage] = -1;
+    job->statuses[stage] = status;
+}
+
+// Converts a wait status into the value reported as the command's exit status.
+static int exit_status(int status)
+{
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return EXIT_FAILURE;
+}
+
+// Waits for every stage of a foreground job, giving it the terminal in the
+// meantime. Returns the status of the last stage.
+int job_wait(job_t *job)
+{
+    bool terminal = job_control && job->pgid > 0;
+    if (terminal) tcsetpgrp(STDIN_FILENO, job->pgid);
+    for (int i = 0; i < job->count; ++i) {
+        if (job->pids[i] <= 0) continue;
+        int status;
+        while (true) {
+            if (waitpid(job->pids[i], &status, terminal ? WUNTRACED : 0) == -1) {
+                perror("nsh: waitpid");
+                break;
+            }
+            // Stopped before the terminal was handed over, or by ^Z, which
+            // needs fg/bg to be useful. Either way it goes on running.
+            if (WIFSTOPPED(status)) {
+                kill(-job->pgid, SIGCONT);
+                continue;
+            }
+            job->statuses[i] = exit_status(status);
+            job->pids[i] = 0;
+            --job->running;
+            break;
+        }
+    }
+    if (terminal) tcsetpgrp(STDIN_FILENO, shell_pgid);
+    return job->statuses[job->count - 1];
+}
+
+// PIPESTATUS holds the statuses of the stages of the last foreground
+// pipeline, separated by spaces.
+void jobs_set_pipestatus(const int *statuses, int count)
+{
+    static int slot = -1;
+    if (slot < 0 && (slot = var_intern("PIPESTATUS", 10)) < 0) return;
+
+    char buff[256];
+    size_t len = 0;
+    buff[0] = '\0';
+    for (int i = 0; i < count && len + 16 < sizeof(buff); ++i) {
+        len += sprintf(buff + len, i == 0 ? "%d" : " %d", statuses[i]);
+    }
+    var_set(slot, buff);
+}
+
+// Puts a started job into the table, taking `text`, which may be NULL.
+bool jobs_add(job_t *job, char *text)
+{
+    int index = 0;
+    while (index < table_size && table[index] != NULL) ++index;
+    if (index == table_size) {
+        int new_size = table_size < 8 ? 8 : table_size * 2;
+        job_t **new_table = realloc(table, sizeof(job_t *) * new_size);
+        if (new_table == NULL) return false;
+        for (int i = table_size; i < new_size; ++i) new_table[i] = NULL;
+        table = new_table;
+        table_size = new_size;
+    }
+    table[index] = job;
+    job->id = last_job = index + 1;
+    job->text = text;
+    return true;
+}
+
+static void jobs_remove(job_t *job)
+{
+    table[job->id - 1] = NULL;
+    job_free(job);
+}
+
+// Records the status of every background stage that has finished. Doesn't
+// block. Only the pids in the table are waited for: the other stages of a
+// foreground pipeline may be running while a builtin calls this, and
+// job_wait() has to find their statuses.
+void jobs_reap(void)
+{
+    struct signalfd_siginfo info;
+    while (read(sigchld_fd, &info, sizeof(info)) > 0) continue;
+
+    for (int i = 0; i < table_size; ++i) {
+        job_t *job = table[i];
+        if (job == NULL) continue;
+        for (int j = 0; j < job->count; ++j) {
+            int status;
+            if (job->pids[j] <= 0 || waitpid(job->pids[j], &status, WNOHANG) <= 0) continue;
+            job->pids[j] = 0;
+            job->statuses[j] = exit_status(status);
+            --job->running;
+        }
+    }
+}
+
+// Drops finished jobs, telling about them if `print`. Interactive shells
+// call this before each prompt.
+void jobs_notify(bool print)
+{
+    jobs_reap();
+    for (int i = 0; i < table_size; ++i) {
+        job_t *job = table[i];
+        if (job == NULL || job->running > 0) continue;
+        if (print) printf("[%d]%c  %-8s %s\n", job->id, job->id == last_job ? '+' : ' ', "Done", job->text);
+        jobs_remove(job);
+    }
+}
+
+// Finished jobs are dropped once shown, so jobs_notify() doesn't tell about
+// them again
+void jobs_print(void)
+{
+    jobs_reap();
+    for (int i = 0; i < table_size; ++i) {
+        job_t *job = table[i];
+        if (job == NULL) continue;
+        printf("[%d]%c  %-8s %s\n", job->id, job->id == last_job ? '+' : ' ',
+               job->running > 0 ? "Running" : "Done", job->text);
+        if (job->running == 0) jobs_remove(job);
+    }
+}
+
+// Finds a job by `%n`, `%%`, `%+` or the pid of one of its stages.
+job_t *jobs_find(const char *spec)
+{
+    char *end;
+    if (strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0) {
+        return (last_job > 0 && last_job <= table_size) ? table[last_job - 1] : NULL;
+    }
+    if (spec[0] == '%') {
+        long id = strtol(spec + 1, &end, 10);
+        if (end == spec + 1 || *end != '\0' || id < 1 || id > table_size) return NULL;
+        return table[id - 1];
+    }
+    long pid = strtol(spec, &end, 10);
+    if (end == spec || *end != '\0' || pid <= 0) return NULL;
+    for (int i = 0; i < table_size; ++i) {
+        job_t *job = table[i];
+        if (job == NULL) continue;
+        for (int j = 0; j < job->count; ++j) {
+            if (job->pids[j] == pid) return job;
+        }
+    }
+    return NULL;
+}
+
+// Blocks until SIGCHLD arrives, then reaps
+static void jobs_block(void)
+{
+    struct pollfd pfd = { sigchld_fd, POLLIN, 0 };
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR) continue;
+    jobs_reap();
+}
+
+// Waits for a background job to finish, removes it and returns its status.
+int jobs_wait(job_t *job)
+{
+    jobs_reap();
+    while (job->running > 0) jobs_block();
+    int status = job->statuses[job->count - 1];
+    jobs_remove(job);
+    return status;
+}
+
+// Waits for the next background job to finish, or takes one that already
+// has. Returns its status, or -1 if there are none.
+int jobs_wait_any(void)
+{
+    jobs_reap();
+    while (true) {
+        bool any = false;
+        for (int i = 0; i < table_size; ++i) {
+            job_t *job = table[i];
+            if (job == NULL) continue;
+            if (job->running == 0) return jobs_wait(job);
+            any = true;
+        }
+        if (!any) return -1;
+        jobs_block();
+    }
+}
+
+void jobs_wait_all(void)
+{
+    for (int i = 0; i < table_size; ++i) {
+        if (table[i] != NULL) jobs_wait(table[i]);
+    }
+}
+
+bool jobs_kill(job_t *job, int sig)
+{
+    if (job->pgid > 0) return kill(-job->pgid, sig) == 0;
+    bool ok = true;
+    for (int i = 0; i < job->count; ++i) {
+        if (job->pids[i] > 0 && kill(job->pids[i], sig) != 0) ok = false;
+    }
+    return ok;
+}
@@ -0,0 +1,43 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+#include <spawn.h>
+#include <sys/types.h>
+
+// The processes started for one pipeline, or for one simple command
+typedef struct job_s {
+    int id;             // in the job table, 0 for a foreground job
+    pid_t pgid;         // 0 until the first stage starts, or without job control
+    int count;          // stages
+    int running;        // stages started and not yet reaped
+    pid_t *pids;        // -1 for a stage that couldn't be started, 0 once reaped
+    int *statuses;      // as reported in PIPESTATUS
+    char *text;         // shown by `jobs`
+} job_t;
+
+void jobs_init(void);
+void jobs_init_control(void);
+bool jobs_control(void);
+int jobs_fd(void);
+
+job_t *job_new(int count);
+void job_free(job_t *job);
+bool job_spawnattr(job_t *job, posix_spawnattr_t *attr);
+void job_started(job_t *job, int stage, pid_t pid);
+void job_enter_child(job_t *job);
+void job_finished(job_t *job, int stage, int status);
+int job_wait(job_t *job);
+void jobs_set_pipestatus(const int *statuses, int count);
+
+bool jobs_add(job_t *job, char *text);
+void jobs_reap(void);
+void jobs_notify(bool print);
+void jobs_print(void);
+job_t *jobs_find(const char *spec);
+int jobs_wait(job_t *job);
+int jobs_wait_any(void);
+void jobs_wait_all(void);
+bool jobs_kill(job_t *job, int sig);
+
+#endif // JOBS_H
@@ -4,13 +4,16 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <ctype.h>
+#include <limits.h>
 #include "lexer.h"
 #include "parser.h"
 #include "utils.h"
 #include "parser_t.inc.h"
 #include "alias.h"
 #include "states.h"
+#include "arena.h"
+#include "scan.h"
+#include "wordtab.h"
 
 #define AEOF -2 // alias EOF
 
@@ -86,12 +89,21 @@ int peek_char_noalias(parser_t *parser)
 {
     // TODO: report error if we read NUL in the input
     if (parser->peek != '\0') return parser->peek;
-    if (parser->curr == parser->input_end) peek_char_return_eof();
-    char *curr = parser->curr;
+    if (parser->curr == parser->input_end) {
+        if (parser->streaming && parser_refill(parser)) return peek_char_noalias(parser);
+        peek_char_return_eof();
+    }
+    const char *curr = parser->curr;
     while (*curr++ == '\\') {
-        if (curr == parser->input_end) break;  // EOF after backslash
+        if (curr == parser->input_end) {  // EOF after backslash
+            if (parser_refill(parser)) return peek_char_noalias(parser);
+            break;
+        }
         if (*curr != '\n') break;
-        if (++curr == parser->input_end) peek_char_return_eof();  // EOF after line concatenation
+        if (++curr == parser->input_end) {  // EOF after line concatenation
+            if (parser_refill(parser)) return peek_char_noalias(parser);
+            peek_char_return_eof();
+        }
     }
     parser->peek = ((uint8_t *)curr)[-1];
     parser->peek_len = curr - parser->curr;
@@ -100,14 +112,13 @@ int peek_char_noalias(parser_t *parser)
 
 int peek_char(parser_t *parser)
 {
-    if (parser->alias_lexer == NULL) return peek_char_noalias(parser);
-    alias_lexer_t *al = parser->alias_lexer;
-    while (al->alias_lexer != NULL) al = al->alias_lexer;
+    alias_lexer_t *al = parser->alias_top;
+    if (al == NULL) return peek_char_noalias(parser);
     if (al->peek != '\0') return al->peek;
 
     // TODO: use macro to merge these code with almost the same code in peek_char_noalias
     if (al->curr == al->input_end) peek_char_return_aeof();
-    char *curr = al->curr;
+    const char *curr = al->curr;
     while (*curr++ == '\\') {
         if (curr == al->input_end) break;
         if (*curr != '\n') break;
@@ -129,17 +140,13 @@ int get_char_noalias(parser_t *parser)
 }
 
 int get_char(parser_t *parser) {
-    if (parser->alias_lexer == NULL) return get_char_noalias(parser);
-    alias_lexer_t *al = parser->alias_lexer;
-    while (al->alias_lexer != NULL) al = al->alias_lexer;
+    alias_lexer_t *al = parser->alias_top;
+    if (al == NULL) return get_char_noalias(parser);
     if (al->peek == '\0') peek_char(parser);
     int ch = al->peek;
     al->curr += al->peek_len;
     if (ch == AEOF) {
-        alias_lexer_t **pal = &parser->alias_lexer;
-        while ((*pal)->alias_lexer != NULL) pal = &(*pal)->alias_lexer;
-        free(*pal);
-        *pal = NULL;
+        parser_pop_alias(parser);
     } else {
         al->peek = '\0';
         al->peek_len = 0;
@@ -147,105 +154,138 @@ int get_char(parser_t *parser) {
     return ch;
 }
 
-static bool is_op2_init(int ch)
+// Character classes of the lexer. The table is computed by the compiler from
+// the CC_OF() expression, so the lexer doesn't depend on the locale.
+enum char_class_e {
+    CC_BLANK = 1 << 0,  // skipped between tokens
+    CC_OP    = 1 << 1,  // starts an operator
+    CC_STOP  = 1 << 2,  // ends a word
+    CC_NAME  = 1 << 3,  // may appear in a variable name
+    CC_DIGIT = 1 << 4,
+    CC_PRINT = 1 << 5,
+    CC_PLAIN = 1 << 6,  // word byte that needs no handling, see skip_plain()
+};
+
+#define CC_IS_OP(c) ((c) == '<' || (c) == '>' || (c) == ';' || (c) == '$' || (c) == '&' \
+                  || (c) == '|' || (c) == '{' || (c) == '}' || (c) == '(' || (c) == ')' || (c) == '!')
+#define CC_IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+#define CC_IS_ALPHA(c) (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z'))
+#define CC_IS_GRAPH(c) ((c) > 0x20 && (c) < 0x7f)
+#define CC_IS_STOP(c) ((CC_IS_OP(c) && (c) != '$') || (c) == '#' || ((c) < 0x80 && !CC_IS_GRAPH(c)))
+#define CC_OF(c) ( \
+      (((c) == ' ' || (c) == '\t') ? CC_BLANK : 0) \
+    | (CC_IS_OP(c) ? CC_OP : 0) \
+    | (CC_IS_STOP(c) ? CC_STOP : 0) \
+    | ((CC_IS_ALPHA(c) || CC_IS_DIGIT(c) || (c) == '_') ? CC_NAME : 0) \
+    | (CC_IS_DIGIT(c) ? CC_DIGIT : 0) \
+    | (((c) >= 0x20 && (c) < 0x7f) ? CC_PRINT : 0) \
+    | ((!CC_IS_STOP(c) && (c) != '$' && (c) != '\'' && (c) != '\\') ? CC_PLAIN : 0))
+#define CC_ROW(n) \
+    CC_OF((n) + 0x0), CC_OF((n) + 0x1), CC_OF((n) + 0x2), CC_OF((n) + 0x3), \
+    CC_OF((n) + 0x4), CC_OF((n) + 0x5), CC_OF((n) + 0x6), CC_OF((n) + 0x7), \
+    CC_OF((n) + 0x8), CC_OF((n) + 0x9), CC_OF((n) + 0xa), CC_OF((n) + 0xb), \
+    CC_OF((n) + 0xc), CC_OF((n) + 0xd), CC_OF((n) + 0xe), CC_OF((n) + 0xf)
+
+static const uint8_t char_class[256] = {
+    CC_ROW(0x00), CC_ROW(0x10), CC_ROW(0x20), CC_ROW(0x30),
+    CC_ROW(0x40), CC_ROW(0x50), CC_ROW(0x60), CC_ROW(0x70),
+    CC_ROW(0x80), CC_ROW(0x90), CC_ROW(0xa0), CC_ROW(0xb0),
+    CC_ROW(0xc0), CC_ROW(0xd0), CC_ROW(0xe0), CC_ROW(0xf0),
+};
+
+// `ch` may be EOF or AEOF, which belong to no class.
+static inline bool char_is(int ch, int cls)
 {
-    return ch == '<' || ch == '>' || ch == ';'
-        || ch == '$' || ch == '&' || ch == '|';
+    return ch >= 0 && (char_class[ch] & cls);
 }
 
-static bool must_be_op1(int ch)
-{
-    return ch == '{' || ch == '}' ||  ch == '(' || ch == ')' || ch == '!';
-}
-
-static bool is_op_init(int ch)
+static bool wont_be_word(int ch)
 {
-    return must_be_op1(ch) || is_op2_init(ch);
+    return ch == EOF || ch == AEOF || char_is(ch, CC_STOP);
 }
 
-static bool can_compose_op2(int ch1, int ch2)
+// Operators are recognised by a state machine whose states are the operator
+// tokens read so far: a character starts one of op1_types, then each
+// transition extends it by one character.
+static const uint8_t op1_types[256] = {
+    ['<'] = TOKEN_LESS,   ['>'] = TOKEN_GREAT,  [';'] = TOKEN_SEMI,
+    ['{'] = TOKEN_LBRACE, ['}'] = TOKEN_RBRACE, ['$'] = TOKEN_DOLLAR,
+    ['('] = TOKEN_LPAREN, [')'] = TOKEN_RPAREN, ['&'] = TOKEN_AMP,
+    ['|'] = TOKEN_BAR,    ['!'] = TOKEN_BANG,
+};
+
+static const struct op_transition_s {
+    uint8_t from;
+    char ch;
+    uint8_t to;
+} op_transitions[] = {
+    { TOKEN_LESS,   '<', TOKEN_DLESS },
+    { TOKEN_LESS,   '>', TOKEN_LESSGREAT },
+    { TOKEN_LESS,   '&', TOKEN_LESSAND },
+    { TOKEN_GREAT,  '>', TOKEN_DGREAT },
+    { TOKEN_GREAT,  '|', TOKEN_CLOBBER },
+    { TOKEN_GREAT,  '&', TOKEN_GREATAND },
+    { TOKEN_SEMI,   ';', TOKEN_DSEMI },
+    { TOKEN_DOLLAR, '(', TOKEN_DOLLAR_LPAREN },
+    { TOKEN_DOLLAR, '{', TOKEN_DOLLAR_LBRACE },
+    { TOKEN_AMP,    '&', TOKEN_DAMP },
+    { TOKEN_BAR,    '|', TOKEN_DBAR },
+    { TOKEN_DLESS,  '-', TOKEN_DLESSDASH },
+};
+
+static token_type_t op_next(token_type_t from, int ch)
 {
-    switch (ch1)
-    {
-    case '<': return ch2 == '<' || ch2 == '>' || ch2 == '&';
-    case '>': return ch2 == '>' || ch2 == '|' || ch2 == '&';
-    case ';': return ch2 == ';';
-    case '$': return ch2 == '(' || ch2 == '{';
-    case '&': return ch2 == '&';
-    case '|': return ch2 == '|';
-    default:
-        return false;
+    for (size_t i = 0; i < sizeof(op_transitions) / sizeof(op_transitions[0]); ++i) {
+        if (op_transitions[i].from == from && op_transitions[i].ch == ch) return op_transitions[i].to;
     }
+    return TOKEN_INVALID;
 }
 
-static bool wont_be_word(int ch)
-{
-    return (is_op_init(ch) && ch != '$') || ch == EOF || ch == AEOF || ch == '#'
-            || (ch < 0x80 && !isgraph(ch));
-}
-
-static token_type_t get_op1_type(int ch)
+// Consumes a run of bytes that get_char() would return unchanged and that
+// can't end the word being read, so they needn't be peeked one by one. Inside
+// single quotes only the closing quote and backslashes need handling.
+static void skip_plain(parser_t *parser, bool single_quote)
 {
-    switch (ch) {
-    case '<': return TOKEN_LESS;
-    case '>': return TOKEN_GREAT;
-    case ';': return TOKEN_SEMI;
-    case '{': return TOKEN_LBRACE;
-    case '}': return TOKEN_RBRACE;
-    case '$': return TOKEN_DOLLAR;
-    case '(': return TOKEN_LPAREN;
-    case ')': return TOKEN_RPAREN;
-    case '&': return TOKEN_AMP;
-    case '|': return TOKEN_BAR;
-    case '!': return TOKEN_BANG;
-    default:  return TOKEN_INVALID;
+    const char **curr = &parser->curr;
+    const char *end = parser->input_end;
+    if (parser->alias_top != NULL) {
+        alias_lexer_t *al = parser->alias_top;
+        if (al->peek != '\0') return;
+        curr = &al->curr;
+        end = al->input_end;
+    } else if (parser->peek != '\0') {
+        return;
     }
-}
 
-static token_type_t get_op2_type(int ch1, int ch2)
-{
-    switch (ch1)
-    {
-    case '<':
-        if (ch2 == '<') return TOKEN_DLESS;
-        if (ch2 == '>') return TOKEN_LESSGREAT;
-        if (ch2 == '&') return TOKEN_LESSAND;
-        return TOKEN_INVALID;
-    case '>':
-        if (ch2 == '>') return TOKEN_DGREAT;
-        if (ch2 == '|') return TOKEN_CLOBBER;
-        if (ch2 == '&') return TOKEN_GREATAND;
-        return TOKEN_INVALID;
-    case ';':
-        return ch2 == ';' ? TOKEN_DSEMI : TOKEN_INVALID;
-    case '$':
-        if (ch2 == '(') return TOKEN_DOLLAR_LPAREN;
-        if (ch2 == '{') return TOKEN_DOLLAR_LBRACE;
-        return TOKEN_INVALID;
-    case '&':
-        return ch2 == '&' ? TOKEN_DAMP : TOKEN_INVALID;
-    case '|':
-        return ch2 == '|' ? TOKEN_DBAR : TOKEN_INVALID;
-    default:
-        return TOKEN_INVALID;
+    const char *p = *curr;
+    if (single_quote) {
+        p = scan_either(p, end, '\'', '\\');
+    } else {
+        p = scan_word(p, end);
+        while (p != end && (char_class[(uint8_t)*p] & CC_PLAIN)) ++p;
     }
+    *curr = p;
 }
 
 static void skip_blanks(parser_t *parser)
 {
-    while (isblank(peek_char(parser))) get_char(parser);
+    while (char_is(peek_char(parser), CC_BLANK)) get_char(parser);
 }
 
+// Leaves the newline in place so it still terminates the command.
 static void skip_till_nl(parser_t *parser)
 {
-    while (get_char(parser) != '\n') continue;
+    int peek;
+    while ((peek = peek_char(parser)) != '\n' && peek != EOF && peek != AEOF) {
+        get_char(parser);
+    }
 }
 
 static void skip_unimportant(parser_t *parser)
 {
     while (true) {
         int peek = peek_char(parser);
-        if (isblank(peek)) {
+        if (char_is(peek, CC_BLANK)) {
             skip_blanks(parser);
         } else if (peek == '#') {
             if (peek_char(parser) == '#') {
@@ -260,24 +300,43 @@ static void skip_unimportant(parser_t *parser)
     }
 }
 
-static token_t *make_token(token_type_t type, const char *begin, const char *end)
+// Hands out a free token slot of the parser. Tokens are only spans, so the
+// payload is copied only once it is pushed into the IL.
+static token_t *make_token(parser_t *parser, token_type_t type, const char *begin, const char *end)
 {
     ptrdiff_t token_len = end - begin;
-    if (token_len < 0) return NULL;
+    if (token_len < 0 || token_len > INT_MAX) return NULL;
 
-    token_t *token = malloc(sizeof(token_t) + token_len + 1);
-    if (token == NULL) return NULL;
+    int slot = 0;
+    while (slot < PARSER_TOKEN_SLOTS && (parser->tokens_used & (UINT32_C(1) << slot))) ++slot;
+    if (slot == PARSER_TOKEN_SLOTS) panic("Out of token slots");
+    parser->tokens_used |= UINT32_C(1) << slot;
 
-    memcpy(token->payload, begin, token_len);
-    token->payload[token_len] = '\0';
+    token_t *token = &parser->tokens[slot];
     token->type = type;
+    token->len = (int)token_len;
+    token->text = begin;
 
     return token;
 }
 
+void free_token(parser_t *parser, token_t *token)
+{
+    if (token == NULL) return;
+    ptrdiff_t slot = token - parser->tokens;
+    if (slot < 0 || slot >= PARSER_TOKEN_SLOTS) return;
+    parser->tokens_used &= ~(UINT32_C(1) << slot);
+}
+
+bool token_is(const token_t *token, const char *str)
+{
+    size_t len = strlen(str);
+    return (size_t)token->len == len && memcmp(token->text, str, len) == 0;
+}
+
 static void expect_keyword(const token_t *token, token_type_t *expected, const char *the_keyword, token_type_t when_match)
 {
-    if (strcmp(token->payload, the_keyword) == 0) {
+    if (token_is(token, the_keyword)) {
         *expected =  when_match;
     }
 }
@@ -286,12 +345,9 @@ static void expect_io_number(parser_t *parser, const token_t *token, token_type_
 {
     if (*expected != TOKEN_WORD_END) return;
 
-    const char *ch = token->payload;
-    while (*ch != '\0') {
-        if (!isdigit(*ch)) return;
-        ++ch;
+    for (int i = 0; i < token->len; ++i) {
+        if (!char_is((uint8_t)token->text[i], CC_DIGIT)) return;
     }
-    if (*ch != '\0') return;
 
     int peek = peek_char(parser);
     if (peek == '<' || peek == '>') *expected = TOKEN_IO_NUMBER;
@@ -299,46 +355,34 @@ static void expect_io_number(parser_t *parser, const token_t *token, token_type_
 
 static bool is_var_part(int ch)
 {
-    return isalnum(ch) || ch == '_';
+    return char_is(ch, CC_NAME);
 }
 
 static void expect_assign_word(const token_t *token, token_type_t *expected)
 {
     if (*expected != TOKEN_WORD_END && *expected != TOKEN_PARTIAL_WORD) return;
 
-    const char *ch = token->payload;
-    if (!isalpha(*ch) && *ch != '_') return;
-    while (*ch != '\0') {
-        if (!is_var_part(*ch)) break;
-        ++ch;
-    }
-    if (*ch == '=') *expected = (*expected == TOKEN_WORD_END) ? TOKEN_ASSIGN_WORD_END : TOKEN_PARTIAL_ASSIGN_WORD;
+    const char *ch = token->text;
+    const char *end = token->text + token->len;
+    if (ch == end || !is_var_part((uint8_t)*ch) || char_is((uint8_t)*ch, CC_DIGIT)) return;
+    while (ch != end && is_var_part((uint8_t)*ch)) ++ch;
+    if (ch != end && *ch == '=') *expected = (*expected == TOKEN_WORD_END) ? TOKEN_ASSIGN_WORD_END : TOKEN_PARTIAL_ASSIGN_WORD;
 }
 
-static bool token_push_alias(parser_t *parser, const char *alias_name)
+static bool token_push_alias(parser_t *parser, const token_t *token)
 {
-    for (alias_lexer_t *al = parser->alias_lexer; al != NULL; al = al->alias_lexer) {
-        if (strcmp(al->alias_name, alias_name) == 0) return false;
+    char name_buf[64];
+    char *alias_name = name_buf;
+    if (token->len >= (int)sizeof(name_buf)) {
+        alias_name = arena_alloc(&line_arena, token->len + 1);
+        if (alias_name == NULL) return false;
     }
-    if (!alias_in(alias_name)) return false;
-    const char *val = alias_get(alias_name);
-    if (val == NULL) return false;
-    // FIXME: check for overflow
-    alias_lexer_t *al = malloc(sizeof(alias_lexer_t) + strlen(val) + 1);
-    if (al == NULL) return false;
-    strcpy(al->input, val);
-    al->alias_name = strdup(alias_name);
-    al->curr = al->input;
-    al->input_end = al->input + strlen(al->input);
-    al->alias_lexer = NULL;
-    al->peek = '\0';
-    al->peek_len = 0;
-
-    alias_lexer_t **pal = &parser->alias_lexer;
-    while (*pal != NULL) pal = &(*pal)->alias_lexer;
-    *pal = al;
-
-    return true;
+    memcpy(alias_name, token->text, token->len);
+    alias_name[token->len] = '\0';
+
+    alias_t *alias = alias_lookup(alias_name);
+    if (alias == NULL || alias->expanding) return false;
+    return parser_push_alias(parser, alias);
 }
 
 static token_type_t token_type_hinting(parser_t *parser, const token_t *token, lex_hint_t hint)
@@ -355,18 +399,9 @@ static token_type_t token_type_hinting(parser_t *parser, const token_t *token, l
         expect_assign_word(token, &type);
         if (!wont_be_word(peek_char(parser))) return type;
         if (hint == LEX_HINT_CMD_PREFIX_KW) {
-            expect_keyword(token, &type, "for",    TOKEN_FOR);
-            expect_keyword(token, &type, "do",     TOKEN_DO);
-            expect_keyword(token, &type, "done",   TOKEN_DONE);
-            expect_keyword(token, &type, "case",   TOKEN_CASE);
-            expect_keyword(token, &type, "esac",   TOKEN_ESAC);
-            expect_keyword(token, &type, "while",  TOKEN_WHILE);
-            expect_keyword(token, &type, "until",  TOKEN_UNTIL);
-            expect_keyword(token, &type, "select", TOKEN_SELECT);
-            expect_keyword(token, &type, "if",     TOKEN_IF);
-            expect_keyword(token, &type, "else",   TOKEN_ELSE);
-            expect_keyword(token, &type, "elif",   TOKEN_ELIF);
-            expect_keyword(token, &type, "fi",     TOKEN_FI);
+            const word_t *word = wordtab_lookup(token->text, token->len);
+            // `in` is only a keyword after `for` or `case`, see LEX_HINT_EXPECT_IN
+            if (word != NULL && word->kind == WORD_KEYWORD && word->keyword != TOKEN_IN) type = word->keyword;
         }
         expect_io_number(parser, token, &type);
         return type;
@@ -382,24 +417,27 @@ static token_type_t token_type_hinting(parser_t *parser, const token_t *token, l
     }
 }
 
-static char *get_parser_curr(parser_t *parser)
+static const char *get_parser_curr(parser_t *parser)
 {
-    if (parser->alias_lexer == NULL) {
-         return parser->curr;
-    } else {
-        alias_lexer_t *al = parser->alias_lexer;
-        while (al->alias_lexer != NULL) al = al->alias_lexer;
-        return al->curr;
-    }
+    return parser->alias_top == NULL ? parser->curr : parser->alias_top->curr;
+}
+
+static const char *get_parser_base(parser_t *parser)
+{
+    return parser->alias_top == NULL ? parser->input : parser->alias_top->input;
+}
+
+// Tokens are located by offset since a refill may move the input buffer.
+static ptrdiff_t get_parser_offset(parser_t *parser)
+{
+    return get_parser_curr(parser) - get_parser_base(parser);
 }
 
 #define RETURN_TOKEN(type) \
     do { \
-        return make_token((type), token_begin, get_parser_curr(parser)); \
+        return make_token(parser, (type), get_parser_base(parser) + token_off, get_parser_curr(parser)); \
     } while (0)
 
-#define RETURN_OP1(ch)      RETURN_TOKEN(get_op1_type((ch)))
-#define RETURN_OP2(a, b)    RETURN_TOKEN(get_op2_type((a), (b)))
 
 static token_t *get_token_(parser_t *parser, lex_hint_t hint)
 {
@@ -407,7 +445,7 @@ static token_t *get_token_(parser_t *parser, lex_hint_t hint)
         skip_unimportant(parser);
     }
 
-    char *token_begin = get_parser_curr(parser);
+    ptrdiff_t token_off = get_parser_offset(parser);
     if (hint == LEX_HINT_COMPOSING_WORD && wont_be_word(peek_char(parser))) {
         RETURN_TOKEN(TOKEN_WORD_END);
     }
@@ -418,26 +456,22 @@ static token_t *get_token_(parser_t *parser, lex_hint_t hint)
     if (ch == '\n') {
         RETURN_TOKEN(TOKEN_NEWLINE);
 
-    // 1ch operator
-    } else if (is_op_init(ch) && !can_compose_op2(ch, peek_char(parser))) {
-        RETURN_OP1(ch);
-
-    // 2ch / 3ch operator
-    } else if (can_compose_op2(ch, peek_char(parser))) {
-        int ch2 = get_char(parser);
-        if (peek_char(parser) != '-') {
-            RETURN_OP2(ch, ch2);
-        } else {
+    // operators
+    } else if (ch >= 0 && op1_types[ch] != TOKEN_INVALID) {
+        token_type_t type = op1_types[ch];
+        token_type_t next;
+        while ((next = op_next(type, peek_char(parser))) != TOKEN_INVALID) {
             get_char(parser);
-            RETURN_TOKEN(TOKEN_DLESSDASH);
+            type = next;
         }
+        RETURN_TOKEN(type);
 
     // EOF
     } else if (ch == EOF) {
         RETURN_TOKEN(TOKEN_EOF);
 
     // unexpected char
-    } else if (!isprint(ch)) {
+    } else if (!char_is(ch, CC_PRINT)) {
         RETURN_TOKEN(TOKEN_INVALID);
     }
 
@@ -448,10 +482,12 @@ static token_t *get_token_(parser_t *parser, lex_hint_t hint)
     if (ch == '\\') backslash = true;
 
     while (true) {
+        if (!backslash) skip_plain(parser, single_quote);
         int peek = peek_char(parser);
 
         // Handle unexpected EOF
         if (peek == EOF && (single_quote || backslash)) {
+            if (parser_refill(parser)) continue;
             parser->last_error = PARSER_ERR_INCOMPLETE;
             RETURN_TOKEN(TOKEN_INVALID);
         }
@@ -464,17 +500,16 @@ static token_t *get_token_(parser_t *parser, lex_hint_t hint)
 
         // Handle normal word termination
         if ((wont_be_word(peek) || peek == '$') && !(single_quote || backslash)) {
-            token_t *token = make_token(TOKEN_PARTIAL_WORD, token_begin, get_parser_curr(parser));
+            token_t *token = make_token(parser, TOKEN_PARTIAL_WORD, get_parser_base(parser) + token_off, get_parser_curr(parser));
             token->type = token_type_hinting(parser, token, hint);
             if (hint != LEX_HINT_CMD_PREFIX && hint != LEX_HINT_CMD_PREFIX_KW) {
                 return token;
             }
             if (token->type == TOKEN_WORD_END) {
-                if (!token_push_alias(parser, token->payload)) return token;
-                token_t *new_token = get_token(parser, LEX_HINT_CMD_PREFIX);
-                if (new_token == NULL) return token;
-                free(token);
-                return new_token;
+                if (!token_push_alias(parser, token)) return token;
+                // Free the slot first so deep alias chains don't pile up tokens
+                free_token(parser, token);
+                return get_token(parser, LEX_HINT_CMD_PREFIX);
             }
             return token;
         }
@@ -506,7 +541,7 @@ token_t *get_token(parser_t *parser, lex_hint_t hint)
             printf("TOKEN_(null)\n");
         } else {
             printf("%s: ", token_type_name(token->type));
-            print_str_repr(token->payload, -1);
+            print_str_repr(token->text, token->len);
             putchar('\n');
         }
     }
@@ -523,20 +558,20 @@ token_t *get_name(parser_t *parser, bool in_brace)
 {
     skip_unimportant(parser);
 
-    char *token_begin = parser->curr;
+    ptrdiff_t token_off = get_parser_offset(parser);
 
     int peek = peek_char(parser);
     if (!(is_var_part(peek) || is_special_param(peek))) return NULL;
 
     int ch = get_char(parser);
     if (is_special_param(ch)) RETURN_TOKEN(TOKEN_NAME);
-    if (isdigit(ch) && !in_brace) RETURN_TOKEN(TOKEN_NAME);
+    if (char_is(ch, CC_DIGIT) && !in_brace) RETURN_TOKEN(TOKEN_NAME);
 
-    bool num_only = isdigit(peek);
+    bool num_only = char_is(peek, CC_DIGIT);
     while (true) {
         peek = peek_char(parser);
         if (!is_var_part(peek)) RETURN_TOKEN(TOKEN_NAME);
-        if (num_only && !isdigit(peek)) RETURN_TOKEN(TOKEN_NAME);
+        if (num_only && !char_is(peek, CC_DIGIT)) RETURN_TOKEN(TOKEN_NAME);
 
         ch = get_char(parser);
     }
@@ -549,14 +584,14 @@ token_t *get_io_number(parser_t *parser)
 {
     skip_unimportant(parser);
 
-    char *token_begin = parser->curr;
+    ptrdiff_t token_off = get_parser_offset(parser);
     int peek = peek_char(parser);
-    if (!isdigit(peek)) {
+    if (!char_is(peek, CC_DIGIT)) {
         parser->last_error = PARSER_ERR_UNEXPECTED;
         return NULL;
     }
 
-    while (isdigit(peek_char(parser))) get_char(parser);
+    while (char_is(peek_char(parser), CC_DIGIT)) get_char(parser);
 
     RETURN_TOKEN(TOKEN_IO_NUMBER);
 }
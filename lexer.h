@@ -68,12 +68,18 @@ typedef enum token_type_e {
 
 typedef struct parser_s parser_t;
 
+// A token is a span of the input or of an alias body, and is not
+// NUL-terminated. Tokens live in slots owned by the parser, so a token is only
+// valid until it is freed or the parser is freed.
 typedef struct token_s {
     token_type_t type;
-    char payload[];
+    int len;
+    const char *text;
 } token_t;
 
 const char *token_type_name(token_type_t type);
+void free_token(parser_t *parser, token_t *token);
+bool token_is(const token_t *token, const char *str);
 int peek_char(parser_t *parser);
 int get_char(parser_t *parser);
 token_t *get_token(parser_t *parser, lex_hint_t hint);
@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <unistd.h>
 #include <readline/readline.h>
 #include "reader.h"
 #include "lexer.h"
@@ -12,9 +13,15 @@
 #include "alias.h"
 #include "vm.h"
 #include "states.h"
+#include "script.h"
+#include "il_cache.h"
+#include "arena.h"
+#include "wordtab.h"
+#include "var.h"
+#include "jobs.h"
 
 //#include "il_t.inc.h"
-//vm_error_t vm_exec1(vm_t *vm, il_t *il);
+//vm_error_t vm_exec1(vm_t *vm, il_list_t *ils, int *pc);
 
 //int main()
 //{
@@ -49,8 +56,7 @@
 //    il_list_pushs(&ils, IL_PUSH_PARTIAL, "ipsum");
 //    il_list_push(&ils, IL_COMPOSE_WORD);
 //    il_list_push(&ils, IL_PUSH_WORDINIT);
-//    il_list_pushs(&ils, IL_PUSH_NAME, "HOME");
-//    il_list_push(&ils, IL_EXPAND_PARAM);
+//    il_list_pushi(&ils, IL_EXPAND_VAR, var_intern("HOME", 4));
 //    il_list_pushs(&ils, IL_PUSH_PARTIAL, "foo");
 //    il_list_pushs(&ils, IL_PUSH_PARTIAL, "bar");
 //    il_list_push(&ils, IL_COMPOSE_WORD);
@@ -74,67 +80,125 @@
 //    return 0;
 //}
 
-int main()
+static int main_noninteractive(int argc, char *argv[])
+{
+    if ((strcmp(argv[1], "-c") == 0 && argc != 3)
+            || (strcmp(argv[1], "-c") != 0 && argc != 2)) {
+        fputs("usage: nsh [-c command | file]\n", stderr);
+        return 2;
+    }
+
+    vm_t *vm = vm_new();
+    if (vm == NULL) panic("vm alloc error");
+    int ret = (strcmp(argv[1], "-c") == 0) ? script_exec_string(vm, argv[2])
+                                           : script_exec_file(vm, argv[1]);
+    vm_free(vm);
+    return ret;
+}
+
+static void debug_print_input(const char *line)
+{
+    if (!state_debug) return;
+    printf("Your input: ");
+    print_str_repr(line, -1);
+    putchar('\n');
+}
+
+// Continuation lines are appended to the parser, which resumes where it
+// stopped instead of parsing the joined input again.
+static bool read_more(parser_t *parser, void *arg)
+{
+    UNUSED_VAR(arg);
+    char *more = reader_readmore();
+    if (more == NULL) return false;
+    more = reader_expand_history(more);
+    debug_print_input(more);
+    bool ok = parser_feed(parser, "\n", "\n" + 1)
+            && parser_feed(parser, more, more + strlen(more));
+    free(more);
+    return ok;
+}
+
+int main(int argc, char *argv[])
 {
     init_env();
+    var_init();
+    jobs_init();
     alias_init();
+    wordtab_init();
+    if (argc > 1) return main_noninteractive(argc, argv);
+    if (!isatty(STDIN_FILENO)) {
+        vm_t *vm = vm_new();
+        if (vm == NULL) panic("vm alloc error");
+        int ret = script_exec_stream(vm, STDIN_FILENO);
+        vm_free(vm);
+        return ret;
+    }
+
+    jobs_init_control();
     reader_set_histsize(NULL);
     reader_load_history();
-    char *line = NULL;
     vm_t *vm = vm_new();
     rl_attempted_completion_function = &reader_completion;
+    rl_getc_function = &reader_getc;
     rl_completer_quote_characters = "'";
 
     while (true) {
-        char *input = (line == NULL) ? reader_readline() : reader_readmore();
-        if (line == NULL) {
-            if (input == NULL) break; else line = input;
-        } else if (input != NULL) {
-            char *new_line = str_join(line, "\n", input);
-            free(line);
-            line = new_line;
-        }
+        // Nothing from the last line is needed any more
+        vm_clear(vm);
+        arena_reset(&line_arena);
+        // Let readline see what the last line exported
+        var_sync_environ();
+        jobs_notify(true);
+
+        char *line = reader_readline();
+        if (line == NULL) break;
         line = reader_expand_history(line);
-        if (state_debug) {
-            printf("Your input: ");
-            print_str_repr(line, -1);
-            putchar('\n');
+        debug_print_input(line);
+
+        il_list_t *cached = il_cache_get(line, line + strlen(line));
+        if (cached != NULL) {
+            vm_clear(vm);
+            vm_exec(vm, cached);
+            reader_addhist(line);
+            free(line);
+            continue;
         }
 
         parser_t *parser = parser_new(line, line + strlen(line));
+        free(line);
+        if (parser == NULL) panic("parser alloc error");
+        parser_set_refill(parser, &read_more, NULL);
+
         token_t *peek = get_token(parser, LEX_HINT_CMD_PREFIX_KW);
         if (peek->type == TOKEN_EOF) {
-            free(peek);
+            free_token(parser, peek);
             parser_free(parser);
-            free(line);
-            line = NULL;
             continue;
         }
         if (state_debug) {
             printf("Initial Peek: %s(", token_type_name(peek->type));
-            print_str_repr(peek->payload, -1);
+            print_str_repr(peek->text, peek->len);
             printf(")\n");
         }
         token_t *subpeek = parse_list(parser, peek);
-        if (subpeek != NULL) free(subpeek);
+        if (subpeek != NULL) free_token(parser, subpeek);
         if (state_debug) parser_dump(parser);
-        if (parser_error(parser) == PARSER_ERR_INCOMPLETE && input != NULL) {
-            if (state_debug) il_list_dump(parser_il_list(parser));
-            free(peek);
-            parser_free(parser);
-            continue;
-        } else if (parser_error(parser) == PARSER_NO_ERROR) {
+        if (parser_error(parser) == PARSER_NO_ERROR) {
+            const char *input = parser_input(parser);
+            il_list_optimize(parser_il_list(parser));
+            if (strchr(input, '\n') == NULL) {
+                il_cache_put(input, input + strlen(input), parser_il_list(parser));
+            }
             vm_clear(vm);
             vm_exec(vm, parser_il_list(parser));
         } else {
             printf("nsh: parser: %s\n", parser_strerror(parser));
         }
 
-        reader_addhist(line);
-        free(peek);
+        reader_addhist(parser_input(parser));
+        free_token(parser, peek);
         parser_free(parser);
-        free(line);
-        line = NULL;
     }
     vm_free(vm);
     reader_save_history();
@@ -4,7 +4,7 @@ CONFIG -= app_bundle
 CONFIG -= qt
 
 QMAKE_CFLAGS += -Wall -Wextra -Werror -Wno-deprecated -std=gnu99
-QMAKE_LFLAGS += -lreadline
+QMAKE_LFLAGS += -lreadline -lpthread
 INCLUDEPATH += $$PWD/3rdparty/libcfu
 
 
@@ -26,7 +26,17 @@ SOURCES += main.c \
     vm_entry.c \
     exec.c \
     builtin.c \
-    states.c
+    states.c \
+    script.c \
+    il_cache.c \
+    il_opt.c \
+    arena.c \
+    scan.c \
+    wordtab.c \
+    var.c \
+    path_cache.c \
+    jobs.c \
+    fileutil.c
 
 HEADERS += \
     lexer.h \
@@ -48,4 +58,13 @@ HEADERS += \
     il_t.inc.h \
     exec.h \
     builtin.h \
-    states.h
+    states.h \
+    script.h \
+    il_cache.h \
+    arena.h \
+    scan.h \
+    wordtab.h \
+    var.h \
+    path_cache.h \
+    jobs.h \
+    fileutil.h
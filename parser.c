@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
@@ -10,24 +11,39 @@
 #include "parser.h"
 #include "parser_t.inc.h"
 #include "il.h"
+#include "var.h"
 
-parser_t *parser_new(char *input_begin, char *input_end)
+// Shown by `debug stats`
+static struct {
+    uint64_t bytes;
+    uint64_t nsec;          // time parsing, excluding refill_nsec
+    uint64_t refill_nsec;   // time waiting for input, in the current parse
+} parser_stats;
+
+static parser_t *parser_alloc(const char *input_begin, const char *input_end)
 {
     if (input_begin == NULL || input_end == NULL) return NULL;
-    ptrdiff_t input_len = input_end - input_begin;
-    if (input_len < 0) return NULL;
+    if (input_end - input_begin < 0) return NULL;
 
-    parser_t *parser = malloc(sizeof(parser_t) + input_len + 1);
+    parser_t *parser = malloc(sizeof(parser_t));
     if (parser == NULL) return NULL;
 
-    memcpy(parser->input, input_begin, input_len);
-    parser->input_end = parser->input + input_len;
-    *parser->input_end = '\0';
+    parser->input = input_begin;
+    parser->input_end = input_end;
     parser->curr = parser->input;
     parser->last_error = PARSER_NO_ERROR;
     parser->peek = '\0';
     parser->peek_len = 0;
-    parser->alias_lexer = NULL;
+    parser->alias_stack = NULL;
+    parser->alias_top = NULL;
+    parser->alias_depth = 0;
+    parser->alias_capacity = 0;
+    parser->owned_input = NULL;
+    parser->owned_capacity = 0;
+    parser->refill = NULL;
+    parser->refill_arg = NULL;
+    parser->streaming = false;
+    parser->tokens_used = 0;
     memset(&parser->il_list, 0, sizeof(il_list_t));
     if (!il_list_init(&parser->il_list)) {
         free(parser);
@@ -37,16 +53,222 @@ parser_t *parser_new(char *input_begin, char *input_end)
     return parser;
 }
 
-static void free_alias_lexer(alias_lexer_t *al) {
-    if (al == NULL) return;
-    if (al->alias_lexer != NULL) free_alias_lexer(al->alias_lexer);
-    free(al);
+parser_t *parser_new(const char *input_begin, const char *input_end)
+{
+    if (input_begin == NULL || input_end == NULL) return NULL;
+    ptrdiff_t input_len = input_end - input_begin;
+    if (input_len < 0) return NULL;
+
+    char *input = malloc(input_len + 1);
+    if (input == NULL) return NULL;
+    memcpy(input, input_begin, input_len);
+    input[input_len] = '\0';
+
+    parser_t *parser = parser_alloc(input, input + input_len);
+    if (parser == NULL) {
+        free(input);
+        return NULL;
+    }
+    parser->owned_input = input;
+    parser->owned_capacity = input_len + 1;
+
+    return parser;
+}
+
+// The input is not copied and need not be NUL-terminated, so it must outlive
+// the parser. Used to parse mmap'ed scripts in place.
+parser_t *parser_new_view(const char *input_begin, const char *input_end)
+{
+    return parser_alloc(input_begin, input_end);
+}
+
+void parser_set_refill(parser_t *parser, parser_refill_t refill, void *arg)
+{
+    parser->refill = refill;
+    parser->refill_arg = arg;
+}
+
+// In streaming mode the end of the input fed so far is never taken as the
+// end of a command: the refill callback is asked for more input first.
+void parser_set_streaming(parser_t *parser, bool streaming)
+{
+    parser->streaming = streaming;
+}
+
+// Points the live tokens spanning the old input buffer into the new one.
+static void rebase_tokens(parser_t *parser, uintptr_t old_input, size_t used, const char *new_input)
+{
+    for (int slot = 0; slot < PARSER_TOKEN_SLOTS; ++slot) {
+        if (!(parser->tokens_used & (UINT32_C(1) << slot))) continue;
+        token_t *token = &parser->tokens[slot];
+        uintptr_t text = (uintptr_t)token->text;
+        if (text >= old_input && text <= old_input + used) {
+            token->text = new_input + (text - old_input);
+        }
+    }
+}
+
+// Makes room for `len` more bytes after the input fed so far and returns
+// where to write them, so a refill callback can read() straight into the
+// parser. A borrowed view is copied into an owned buffer first.
+char *parser_reserve(parser_t *parser, size_t len)
+{
+    if (parser == NULL) return NULL;
+    size_t used = parser->input_end - parser->input;
+    if (len > SIZE_MAX - used - 1) return NULL;
+    if (used + len + 1 > parser->owned_capacity) {
+        size_t new_cap = parser->owned_capacity < 64 ? 64 : parser->owned_capacity;
+        while (new_cap < used + len + 1) {
+            if (new_cap > SIZE_MAX / 2) return NULL;
+            new_cap *= 2;
+        }
+        uintptr_t old_input = (uintptr_t)parser->input;
+        char *new_input = realloc(parser->owned_input, new_cap);
+        if (new_input == NULL) return NULL;
+        if (parser->owned_input == NULL) memcpy(new_input, parser->input, used);
+        rebase_tokens(parser, old_input, used, new_input);
+        parser->curr = new_input + (parser->curr - parser->input);
+        parser->input = parser->owned_input = new_input;
+        parser->input_end = new_input + used;
+        parser->owned_capacity = new_cap;
+    }
+    return parser->owned_input + used;
+}
+
+// Appends `len` bytes written after parser_reserve(). The lexer position and
+// the IL generated so far are kept, so new input costs only its own length.
+void parser_commit(parser_t *parser, size_t len)
+{
+    parser->input_end += len;
+    parser->owned_input[parser->input_end - parser->input] = '\0';
+    if (parser->peek == EOF) {
+        parser->peek = '\0';
+        parser->peek_len = 0;
+    }
+}
+
+bool parser_feed(parser_t *parser, const char *begin, const char *end)
+{
+    if (begin == NULL || end == NULL || end < begin) return false;
+    char *dest = parser_reserve(parser, end - begin);
+    if (dest == NULL) return false;
+    memcpy(dest, begin, end - begin);
+    parser_commit(parser, end - begin);
+    return true;
+}
+
+// Drops the input that has already been parsed, keeping memory bounded when
+// streaming. Only call it between commands.
+void parser_discard(parser_t *parser)
+{
+    if (parser->owned_input == NULL || parser->alias_top != NULL) return;
+    size_t left = parser->input_end - parser->curr;
+    memmove(parser->owned_input, parser->curr, left + 1);
+    parser->curr = parser->input;
+    parser->input_end = parser->input + left;
+}
+
+// Returns the offset of the lexer in the input, or -1 if it is reading an
+// alias or has a character peeked.
+ptrdiff_t parser_tell(parser_t *parser)
+{
+    if (parser->alias_top != NULL || parser->peek != '\0') return -1;
+    return parser->curr - parser->input;
+}
+
+const char *parser_text(parser_t *parser, ptrdiff_t offset)
+{
+    return parser->input + offset;
+}
+
+// Finds the next line of input without lexing it, so that callers can look
+// it up in the IL cache. Fails if the line isn't fully buffered yet.
+bool parser_next_line(parser_t *parser, const char **begin, const char **end)
+{
+    if (parser_tell(parser) < 0) return false;
+    const char *nl = memchr(parser->curr, '\n', parser->input_end - parser->curr);
+    if (nl == NULL) {
+        if (parser->streaming || parser->refill != NULL) return false;
+        nl = parser->input_end;
+    }
+    *begin = parser->curr;
+    *end = nl;
+    return true;
+}
+
+// Skips the line found by parser_next_line() along with its newline.
+void parser_skip_line(parser_t *parser)
+{
+    const char *begin, *end;
+    if (!parser_next_line(parser, &begin, &end)) return;
+    parser->curr = (end == parser->input_end) ? end : end + 1;
+}
+
+bool parser_refill(parser_t *parser)
+{
+    if (parser->refill == NULL) return false;
+    uint64_t begin = now_nsec();
+    bool refilled = parser->refill(parser, parser->refill_arg);
+    parser_stats.refill_nsec += now_nsec() - begin;
+    return refilled;
+}
+
+// Frees every token still held, e.g. ones leaked by an error path. Only call
+// it between commands.
+void parser_release_tokens(parser_t *parser)
+{
+    parser->tokens_used = 0;
+}
+
+bool parser_in_alias(parser_t *parser)
+{
+    return parser->alias_top != NULL;
+}
+
+// Starts reading the body of `alias`, which is marked as expanding so that it
+// isn't expanded again inside itself.
+bool parser_push_alias(parser_t *parser, alias_t *alias)
+{
+    if (parser->alias_depth == parser->alias_capacity) {
+        int new_cap = parser->alias_capacity < 4 ? 4 : parser->alias_capacity * 2;
+        alias_lexer_t *new_stack = realloc(parser->alias_stack, new_cap * sizeof(alias_lexer_t));
+        if (new_stack == NULL) return false;
+        parser->alias_stack = new_stack;
+        parser->alias_capacity = new_cap;
+    }
+    alias_lexer_t *al = &parser->alias_stack[parser->alias_depth++];
+    al->alias = alias_ref(alias);
+    al->input = alias->value;
+    al->input_end = alias->value + alias->len;
+    al->curr = al->input;
+    al->peek = '\0';
+    al->peek_len = 0;
+    alias->expanding = true;
+    parser->alias_top = al;
+    return true;
+}
+
+void parser_pop_alias(parser_t *parser)
+{
+    alias_lexer_t *al = parser->alias_top;
+    al->alias->expanding = false;
+    alias_unref(al->alias);
+    --parser->alias_depth;
+    parser->alias_top = parser->alias_depth > 0 ? al - 1 : NULL;
+}
+
+// Returns all the input fed so far, or NULL for a borrowed view.
+const char *parser_input(parser_t *parser)
+{
+    return parser->owned_input;
 }
 
 void parser_free(parser_t *parser)
 {
     il_list_free(&parser->il_list);
-    free_alias_lexer(parser->alias_lexer);
+    while (parser->alias_top != NULL) parser_pop_alias(parser);
+    free(parser->alias_stack);
+    free(parser->owned_input);
     free(parser);
 }
 
@@ -78,11 +300,11 @@ void parser_dump(parser_t *parser)
 {
     printf("<<<<<===== PARSER DUMP BEGIN OF %p =====<<<<<\n", parser);
     printf("input:      %p\n", parser->input);
-    printf("input_end:  %p\n", parser->input);
+    printf("input_end:  %p\n", parser->input_end);
     printf("curr:       %p\n", parser->curr);
     printf("(index):    %lld\n", (long long)(parser->curr - parser->input));
     printf("(prec):     ");
-    print_str_repr(parser->curr, 16);
+    print_str_repr(parser->curr, (int)(parser->input_end - parser->curr < 16 ? parser->input_end - parser->curr : 16));
     printf("\nlast_error: %s\n", parser_strerror(parser));
     printf("peek: (\\x%02x) '", parser->peek);
     print_char_repr(parser->peek);
@@ -100,10 +322,23 @@ il_list_t *parser_il_list(parser_t *parser)
     return &parser->il_list;
 }
 
+void parser_print_stats(void)
+{
+    double secs = parser_stats.nsec / 1e9;
+    printf("parser: %llu bytes in %.3f ms (%.1f MB/s)\n",
+           (unsigned long long)parser_stats.bytes, secs * 1e3,
+           secs > 0 ? parser_stats.bytes / secs / 1e6 : 0.0);
+}
+
 #define PARSER_ASSERT_NOT_EOF(x) \
     do { \
+        if (peek->type == TOKEN_EOF && parser_refill(parser)) { \
+            if (peek != token) free_token(parser, peek); \
+            peek = get_token(parser, (x)); \
+        } \
         if (peek->type == TOKEN_EOF) { \
             parser->last_error = PARSER_ERR_INCOMPLETE; \
+            if (peek != token) free_token(parser, peek); \
             return NULL; \
         } \
     } while (0)
@@ -119,22 +354,34 @@ il_list_t *parser_il_list(parser_t *parser)
 #define PARSER_THROW(x) \
     do { \
         printf("Exception in %s (%s@%d)\n", __PRETTY_FUNCTION__, __FILE__, __LINE__); \
-        printf("peek = %s(\033[100m\033[97m%s\033[0m)\n", token_type_name(peek->type), peek->payload); \
+        printf("peek = %s(\033[100m\033[97m%.*s\033[0m)\n", token_type_name(peek->type), peek->len, peek->text); \
         parser->last_error = (x); \
-        if (peek != token) free(peek); \
+        if (peek != token) free_token(parser, peek); \
         return NULL; \
     } while (0)
 
-#define PARSER_NEXT(x) do { if (peek != token) free(peek); peek = get_token(parser, (x)); } while (0)
+#define PARSER_NEXT(x) do { if (peek != token) free_token(parser, peek); peek = get_token(parser, (x)); } while (0)
 
 #define PARSER_RETURN() do { return (peek != token) ? peek : NULL; } while (0)
 
 #define PARSER_ASSERT_NULL(x) do { if ((x) != NULL) PARSER_THROW(PARSER_ERR_UNEXPECTED); } while (0)
 
 #define PARSER_PUSH_IL(t) il_list_push(&parser->il_list, (t))
-#define PARSER_PUSH_ILs(t, p) il_list_pushs(&parser->il_list, (t), (p))
+#define PARSER_PUSH_ILs(t, p) il_list_pushsn(&parser->il_list, (t), (p)->text, (p)->len)
 #define PARSER_PUSH_ILi(t, p) il_list_pushi(&parser->il_list, (t), (p))
 
+// Variable names are resolved to slots here, once, rather than looked up by
+// name every time the IL runs.
+static void push_expand_var(parser_t *parser, token_t *var_name)
+{
+    int slot = var_intern(var_name->text, (size_t)var_name->len);
+    if (slot < 0) {
+        parser->last_error = PARSER_ERR_INTERNAL;
+        return;
+    }
+    PARSER_PUSH_ILi(IL_EXPAND_VAR, slot);
+}
+
 token_t *parse_param_expand(parser_t *parser, token_t *token)
 {
     CHECK_PARSER();
@@ -144,20 +391,23 @@ token_t *parse_param_expand(parser_t *parser, token_t *token)
         token_t *var_name = get_name(parser, false);
 
         if (var_name != NULL) {
-            PARSER_PUSH_ILs(IL_PUSH_NAME, var_name->payload);
-            PARSER_PUSH_IL(IL_EXPAND_PARAM);
+            push_expand_var(parser, var_name);
         } else {
             parser->last_error = PARSER_ERR_UNEXPECTED;
         }
 
-        free(var_name);
+        free_token(parser, var_name);
         return NULL;
     }
 
     token_t *var_name = get_name(parser, true);
-    PARSER_PUSH_ILs(IL_PUSH_NAME, var_name->payload);
-    PARSER_PUSH_IL(IL_EXPAND_PARAM);
-    free(var_name);
+    if (var_name == NULL) {
+        parser->last_error = PARSER_ERR_UNEXPECTED;
+        return NULL;
+    }
+    push_expand_var(parser, var_name);
+    free_token(parser, var_name);
+    if (parser->last_error != PARSER_NO_ERROR) return NULL;
 
     int peek = peek_char(parser);
     switch (peek)
@@ -197,35 +447,48 @@ token_t *parse_word(parser_t *parser, token_t *token)
     while (keep_parsing) {
         if (partial->type == TOKEN_DOLLAR || partial->type == TOKEN_DOLLAR_LBRACE) {
             token_t *peek = parse_param_expand(parser, partial);
-            if (peek != NULL) free(peek);
+            if (peek != NULL) free_token(parser, peek);
             PARSER_ASSERT(peek == NULL);
         } else if (partial->type == TOKEN_PARTIAL_WORD || partial->type == TOKEN_PARTIAL_ASSIGN_WORD) {
-            PARSER_PUSH_ILs(IL_PUSH_PARTIAL, partial->payload);
+            PARSER_PUSH_ILs(IL_PUSH_PARTIAL, partial);
         } else if (partial->type == TOKEN_WORD_END) {
-            PARSER_PUSH_ILs(IL_PUSH_PARTIAL, partial->payload);
+            PARSER_PUSH_ILs(IL_PUSH_PARTIAL, partial);
             PARSER_PUSH_IL(IL_COMPOSE_WORD);
             if (token->type == TOKEN_PARTIAL_ASSIGN_WORD) {
                 PARSER_PUSH_IL(IL_ASSIGN_WORD);
             }
             keep_parsing = false;
         } else if (partial->type == TOKEN_ASSIGN_WORD_END) {
-            PARSER_PUSH_ILs(IL_PUSH_PARTIAL, partial->payload);
+            PARSER_PUSH_ILs(IL_PUSH_PARTIAL, partial);
             PARSER_PUSH_IL(IL_COMPOSE_WORD);
             PARSER_PUSH_IL(IL_ASSIGN_WORD);
             keep_parsing = false;
         } else {
-            if (partial != token) free(partial);
+            if (partial != token) free_token(parser, partial);
             parser->last_error = PARSER_ERR_UNEXPECTED;
             return NULL;
         }
 
-        if (partial != token) free(partial);
+        if (partial != token) free_token(parser, partial);
         if (keep_parsing) partial = get_token(parser, LEX_HINT_COMPOSING_WORD);
     }
 
     return NULL;
 }
 
+static bool token_to_fd(const token_t *token, int *fd)
+{
+    if (token->len == 0) return false;
+    int value = 0;
+    for (int i = 0; i < token->len; ++i) {
+        if (!isdigit(token->text[i])) return false;
+        if (value > (INT_MAX - 9) / 10) return false;
+        value = value * 10 + (token->text[i] - '0');
+    }
+    *fd = value;
+    return true;
+}
+
 token_t *parse_io_redir(parser_t *parser, token_t *token)
 {
     CHECK_PARSER();
@@ -245,12 +508,11 @@ token_t *parse_io_redir(parser_t *parser, token_t *token)
     token_t *redir_op = token;
 
     if (token->type == TOKEN_IO_NUMBER) {
-        PARSER_ASSERT(sscanf(token->payload, "%d", &fd) == 1);
-        PARSER_ASSERT(fd >= 0);
+        PARSER_ASSERT(token_to_fd(token, &fd));
         redir_op = get_token(parser, LEX_NO_HINT);
     }
 
-    if (redir_op->payload[0] == '<') {
+    if (redir_op->text[0] == '<') {
         fd = fd < 0 ? 0 : fd;
     } else {
         fd = fd < 0 ? 1 : fd;
@@ -268,31 +530,31 @@ token_t *parse_io_redir(parser_t *parser, token_t *token)
     case TOKEN_CLOBBER:   redir_type = IO_REDIR_OUTPUT_CLOBBER; break;
     default:
         parser->last_error = PARSER_ERR_UNEXPECTED;
-        if (token->type == TOKEN_IO_NUMBER) free(redir_op);
+        if (token->type == TOKEN_IO_NUMBER) free_token(parser, redir_op);
         return NULL;
     }
 
-    if (redir_op != token) free(redir_op);
+    if (redir_op != token) free_token(parser, redir_op);
 
     if (redir_type != IO_REDIR_INPUT_DUP && redir_type != IO_REDIR_OUTPUT_DUP) {
         token_t *peek = get_token(parser, LEX_NO_HINT);
         token_t *subpeek = parse_word(parser, peek);
         if (subpeek != NULL) {
-            free(subpeek);
+            free_token(parser, subpeek);
             parser->last_error = PARSER_ERR_UNEXPECTED;
         }
-        free(peek);
+        free_token(parser, peek);
         if (subpeek != NULL) return NULL;
     } else {
         token_t *peek = get_io_number(parser);
         int fd_dup = -1;
         if (peek != NULL) {
-            if(!(sscanf(peek->payload, "%d", &fd_dup) == 1) || fd_dup < 0) {
-                free(peek);
+            if (!token_to_fd(peek, &fd_dup)) {
+                free_token(parser, peek);
                 parser->last_error = PARSER_ERR_UNEXPECTED;
                 return NULL;
             }
-            free(peek);
+            free_token(parser, peek);
             PARSER_PUSH_ILi(IL_PUSH_FD, fd_dup);
         }
     }
@@ -387,12 +649,12 @@ token_t *parse_simple_cmd(parser_t *parser, token_t *token)
     do { \
         token_t *subpeek = (x); \
         if (parser->last_error != PARSER_NO_ERROR) { \
-            if (subpeek != NULL && subpeek != token) free(subpeek); \
-            if (peek != token) free(peek); \
+            if (subpeek != NULL && subpeek != token) free_token(parser, subpeek); \
+            if (peek != token) free_token(parser, peek); \
             return NULL; \
         } \
         if (subpeek == NULL) subpeek = get_token(parser, LEX_HINT_CMD_PREFIX_KW); \
-        if (peek != token) free(peek); \
+        if (peek != token) free_token(parser, peek); \
         peek = subpeek; \
     } while (0)
 
@@ -400,10 +662,10 @@ token_t *parse_simple_cmd(parser_t *parser, token_t *token)
     do { \
         if (peek->type != (x)) { \
             parser->last_error = PARSER_ERR_UNEXPECTED; \
-            if (peek != token) free(peek); \
+            if (peek != token) free_token(parser, peek); \
             return NULL; \
         } \
-        if (peek != token) free(peek); \
+        if (peek != token) free_token(parser, peek); \
         peek = get_token(parser, LEX_HINT_CMD_PREFIX_KW); \
     } while (0)
 
@@ -467,9 +729,11 @@ token_t *parse_pipeline(parser_t *parser, token_t *token)
 
     while(peek->type == TOKEN_BAR) {
         PARSER_MATCH(TOKEN_BAR);
-        PARSER_ASSERT_NOT_EOF();
-        if (peek->type == TOKEN_NEWLINE) {
-            PARSER_EXEC(parse_newlines(parser, peek));
+        while (peek->type == TOKEN_EOF || peek->type == TOKEN_NEWLINE) {
+            PARSER_ASSERT_NOT_EOF(LEX_HINT_CMD_PREFIX_KW);
+            if (peek->type == TOKEN_NEWLINE) {
+                PARSER_EXEC(parse_newlines(parser, peek));
+            }
         }
         PARSER_EXEC(parse_command(parser, peek));
         PARSER_PUSH_IL(IL_PIPELINE_LINK);
@@ -501,7 +765,10 @@ static bool is_list_first(token_t *token)
     }
 }
 
-token_t *parse_list(parser_t *parser, token_t *token)
+// When `one_line` is set, parsing stops at the first newline ending the list
+// and the NEWLINE token is returned as the peek, so callers can execute each
+// complete command before reading the next one.
+static token_t *parse_list_(parser_t *parser, token_t *token, bool one_line)
 {
     CHECK_PARSER();
 
@@ -520,7 +787,7 @@ token_t *parse_list(parser_t *parser, token_t *token)
         case TOKEN_SEMI:
             if (has_command) PARSER_PUSH_IL(IL_EXEC_PIPELINE);
             PARSER_MATCH(TOKEN_SEMI);
-            if (peek->type == TOKEN_NEWLINE) {
+            if (peek->type == TOKEN_NEWLINE && !one_line) {
                 PARSER_EXEC(parse_newlines(parser, peek));
             }
             break;
@@ -530,12 +797,13 @@ token_t *parse_list(parser_t *parser, token_t *token)
             }
             PARSER_PUSH_IL(IL_EXEC_BACKGROUND);
             PARSER_MATCH(TOKEN_AMP);
-            if (peek->type == TOKEN_NEWLINE) {
+            if (peek->type == TOKEN_NEWLINE && !one_line) {
                 PARSER_EXEC(parse_newlines(parser, peek));
             }
             break;
         case TOKEN_NEWLINE:
             PARSER_PUSH_IL(IL_EXEC_PIPELINE);
+            if (one_line) PARSER_RETURN();
             PARSER_EXEC(parse_newlines(parser, peek));
             break;
         default:
@@ -545,3 +813,25 @@ token_t *parse_list(parser_t *parser, token_t *token)
 
     PARSER_RETURN();
 }
+
+static token_t *parse_list_timed(parser_t *parser, token_t *token, bool one_line)
+{
+    uint64_t begin = now_nsec();
+    ptrdiff_t begin_off = parser->curr - parser->input;
+    parser_stats.refill_nsec = 0;
+    token_t *peek = parse_list_(parser, token, one_line);
+    uint64_t total = now_nsec() - begin;
+    parser_stats.nsec += total > parser_stats.refill_nsec ? total - parser_stats.refill_nsec : 0;
+    parser_stats.bytes += (parser->curr - parser->input) - begin_off;
+    return peek;
+}
+
+token_t *parse_list(parser_t *parser, token_t *token)
+{
+    return parse_list_timed(parser, token, false);
+}
+
+token_t *parse_complete_command(parser_t *parser, token_t *token)
+{
+    return parse_list_timed(parser, token, true);
+}
@@ -1,6 +1,7 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <stddef.h>
 #include "il.h"
 
 typedef enum parser_error_e {
@@ -14,13 +15,33 @@ typedef enum parser_error_e {
 typedef struct parser_s parser_t;
 typedef struct token_s token_t;
 
-parser_t *parser_new(char *input_begin, char *input_end);
+// Called when the parser runs out of input in the middle of a command. It
+// should append more input with parser_feed() and return true, or return
+// false if there is no more input.
+typedef bool (*parser_refill_t)(parser_t *parser, void *arg);
+
+parser_t *parser_new(const char *input_begin, const char *input_end);
+parser_t *parser_new_view(const char *input_begin, const char *input_end);
 void parser_free(parser_t *parser);
+void parser_set_refill(parser_t *parser, parser_refill_t refill, void *arg);
+void parser_set_streaming(parser_t *parser, bool streaming);
+char *parser_reserve(parser_t *parser, size_t len);
+void parser_commit(parser_t *parser, size_t len);
+bool parser_feed(parser_t *parser, const char *begin, const char *end);
+void parser_discard(parser_t *parser);
+ptrdiff_t parser_tell(parser_t *parser);
+const char *parser_text(parser_t *parser, ptrdiff_t offset);
+bool parser_next_line(parser_t *parser, const char **begin, const char **end);
+void parser_skip_line(parser_t *parser);
+const char *parser_input(parser_t *parser);
+void parser_release_tokens(parser_t *parser);
+bool parser_in_alias(parser_t *parser);
 bool parser_no_error(parser_t *parser);
 const char *parser_strerror(parser_t *parser);
 void parser_dump(parser_t *parser);
 parser_error_t parser_error(parser_t *parser);
 il_list_t *parser_il_list(parser_t *parser);
+void parser_print_stats(void);
 
 // We use LL(1)-like parser to parse input. The parameter `token` of these
 // functions means peeked token of the previous or upper rule, the returned
@@ -36,5 +57,6 @@ token_t *parse_command(parser_t *parser, token_t *token);
 token_t *parse_newlines(parser_t *parser, token_t *token);
 token_t *parse_pipeline(parser_t *parser, token_t *token);
 token_t *parse_list(parser_t *parser, token_t *token);
+token_t *parse_complete_command(parser_t *parser, token_t *token);
 
 #endif // PARSER_H
@@ -1,32 +1,50 @@
 #ifndef PARSER_T_INC_H
 #define PARSER_T_INC_H
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "parser.h"
+#include "lexer.h"
 #include "il_t.inc.h"
+#include "alias.h"
 
-typedef struct alias_lexer_s alias_lexer_t;
+#define PARSER_TOKEN_SLOTS 32
 
+// A frame of the alias expansion stack, reading the body of `alias`
 typedef struct alias_lexer_s {
-    const char *alias_name;
-    char *input_end;
-    char *curr;
-    alias_lexer_t *alias_lexer;
+    alias_t *alias;
+    const char *input;
+    const char *input_end;
+    const char *curr;
     int peek;
     int peek_len;
-    char input[];
 } alias_lexer_t;
 
 typedef struct parser_s {
-    char *input_end;
-    char *curr;
+    const char *input;      // either owned_input or a view borrowed from the caller
+    const char *input_end;
+    const char *curr;
     parser_error_t last_error;
     int peek;
     int peek_len;
     il_list_t il_list;
-    alias_lexer_t *alias_lexer;
-    char input[];
+    alias_lexer_t *alias_stack;
+    alias_lexer_t *alias_top;   // innermost frame, or NULL when not in an alias
+    int alias_depth;
+    int alias_capacity;
+    char *owned_input;      // NULL when parsing a borrowed view
+    size_t owned_capacity;
+    parser_refill_t refill;
+    void *refill_arg;
+    bool streaming;
+    token_t tokens[PARSER_TOKEN_SLOTS];
+    uint32_t tokens_used;   // bitmap of the slots in `tokens` handed out
 } parser_t;
 
+bool parser_refill(parser_t *parser);
+bool parser_push_alias(parser_t *parser, alias_t *alias);
+void parser_pop_alias(parser_t *parser);
+
 #define CHECK_PARSER() \
 do { \
     if (parser == NULL || parser->last_error != PARSER_NO_ERROR) return NULL; \
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "path_cache.h"
+#include "utils.h"
+#include "var.h"
+#include "cfuhash.h"
+
+// Maps command names to where they were found in PATH, so that running a
+// command again doesn't search PATH with a failed stat() per directory.
+// Names that weren't found are cached too, but only for a short while, so a
+// newly installed command shows up without `hash -r`. The whole cache is
+// dropped when PATH changes.
+
+static const uint64_t PATH_CACHE_NEGATIVE_NSEC = 2000000000ull;
+
+typedef struct path_entry_s {
+    char *path;         // NULL if not found
+    uint64_t when;      // when a NULL path was found
+    unsigned long hits;
+} path_entry_t;
+
+static cfuhash_table_t *path_cache = NULL;
+static int path_slot = -1;
+static unsigned long path_cache_path_gen = 0;
+static unsigned long path_cache_hits = 0;
+static unsigned long path_cache_misses = 0;
+
+static void path_cache_free_entry(void *data)
+{
+    path_entry_t *entry = data;
+    free(entry->path);
+    free(entry);
+}
+
+static void path_cache_delete(void)
+{
+    if (path_cache != NULL) cfuhash_destroy(path_cache);
+    path_cache = NULL;
+}
+
+static bool path_cache_init(void)
+{
+    if (path_cache != NULL) return true;
+    path_slot = var_intern("PATH", 4);
+    if (path_slot < 0) return false;
+    path_cache = cfuhash_new_with_free_fn(&path_cache_free_entry);
+    if (path_cache == NULL) return false;
+    cfuhash_set_flag(path_cache, CFUHASH_NO_LOCKING);
+    path_cache_path_gen = var_generation(path_slot);
+    atexit(&path_cache_delete);
+    return true;
+}
+
+static bool path_cache_valid(void)
+{
+    if (!path_cache_init()) return false;
+    if (path_cache_path_gen != var_generation(path_slot)) {
+        cfuhash_clear(path_cache);
+        path_cache_path_gen = var_generation(path_slot);
+    }
+    return true;
+}
+
+// Returns the first executable file called `name` in the colon separated
+// directories of `path`, malloc()ed, or NULL. An empty directory means the
+// current one.
+char *path_search(const char *name, const char *path)
+{
+    if (path == NULL) return NULL;
+    size_t name_len = strlen(name);
+    char buff[PATH_MAX];
+    for (const char *dir = path; ; ++dir) {
+        const char *end = strchr(dir, ':');
+        if (end == NULL) end = dir + strlen(dir);
+        size_t dir_len = end - dir;
+        if (dir_len == 0) {
+            buff[dir_len++] = '.';
+        } else if (dir_len < sizeof(buff)) {
+            memcpy(buff, dir, dir_len);
+        }
+        if (dir_len + name_len + 2 <= sizeof(buff)) {
+            buff[dir_len] = '/';
+            memcpy(buff + dir_len + 1, name, name_len + 1);
+            struct stat st;
+            if (stat(buff, &st) == 0 && S_ISREG(st.st_mode) && access(buff, X_OK) == 0) {
+                return strdup(buff);
+            }
+        }
+        if (*end == '\0') return NULL;
+        dir = end;
+    }
+}
+
+// Returns where the command `name` is, searching PATH only if it hasn't been
+// seen since PATH last changed, or NULL if it isn't anywhere.
+const char *path_cache_find(const char *name)
+{
+    if (!path_cache_valid()) return NULL;
+
+    void *data = NULL;
+    if (cfuhash_get_data(path_cache, name, -1, &data, NULL)) {
+        path_entry_t *entry = data;
+        if (entry->path != NULL || now_nsec() - entry->when < PATH_CACHE_NEGATIVE_NSEC) {
+            ++path_cache_hits;
+            ++entry->hits;
+            return entry->path;
+        }
+    }
+    ++path_cache_misses;
+
+    path_entry_t *entry = malloc(sizeof(path_entry_t));
+    if (entry == NULL) return NULL;
+    entry->path = path_search(name, var_get(path_slot));
+    entry->when = now_nsec();
+    entry->hits = 0;
+    cfuhash_put_data(path_cache, name, -1, entry, sizeof(path_entry_t), NULL);
+    return entry->path;
+}
+
+// For a cached path that turned out not to work
+void path_cache_forget(const char *name)
+{
+    if (path_cache != NULL) cfuhash_delete_data(path_cache, name, -1);
+}
+
+void path_cache_clear(void)
+{
+    if (path_cache != NULL) cfuhash_clear(path_cache);
+}
+
+static int path_cache_print_entry(void *key, size_t key_size, void *data, size_t data_size, void *arg)
+{
+    UNUSED_VAR(key_size); UNUSED_VAR(data_size); UNUSED_VAR(arg);
+    path_entry_t *entry = data;
+    if (entry->path != NULL) printf("%8lu %s\n", entry->hits, entry->path);
+    else printf("%8s %s (not found)\n", "-", (const char *)key);
+    return 0;
+}
+
+void path_cache_print(void)
+{
+    if (!path_cache_valid()) return;
+    printf("%8s %s\n", "hits", "command");
+    cfuhash_foreach(path_cache, &path_cache_print_entry, NULL);
+}
+
+void path_cache_print_stats(void)
+{
+    printf("path cache: %lu hits, %lu misses, %lu entries\n", path_cache_hits,
+           path_cache_misses, (unsigned long)(path_cache ? cfuhash_num_entries(path_cache) : 0));
+}
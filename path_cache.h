@@ -0,0 +1,13 @@
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+#include <stdbool.h>
+
+char *path_search(const char *name, const char *path);
+const char *path_cache_find(const char *name);
+void path_cache_forget(const char *name);
+void path_cache_clear(void);
+void path_cache_print(void);
+void path_cache_print_stats(void);
+
+#endif // PATH_CACHE_H
@@ -8,8 +8,27 @@
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <errno.h>
+#include <poll.h>
 #include "states.h"
 #include "utils.h"
+#include "jobs.h"
+
+// Waits for a key, reaping background jobs that finish in the meantime
+int reader_getc(FILE *stream)
+{
+    struct pollfd fds[2] = {
+        { fileno(stream), POLLIN, 0 },
+        { jobs_fd(), POLLIN, 0 },
+    };
+    while (true) {
+        int n = poll(fds, 2, -1);
+        if (n < 0 && errno != EINTR) break;
+        if (n <= 0) continue;
+        if (fds[1].revents & POLLIN) jobs_reap();
+        if (fds[0].revents != 0) break;
+    }
+    return rl_getc(stream);
+}
 
 char *reader_readline()
 {
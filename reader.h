@@ -1,8 +1,11 @@
 #ifndef READER__H
 #define READER__H
 
+#include <stdio.h>
+
 char *reader_readline();
 char *reader_readmore();
+int reader_getc(FILE *stream);
 void reader_addhist(const char *line);
 char **reader_completion(const char *text, int start, int end);
 char *reader_expand_history(char *line);
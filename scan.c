@@ -0,0 +1,98 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "scan.h"
+#include "utils.h"
+
+#if defined(__GNUC__) && defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_BLOCK 32
+typedef __m256i vec_t;
+#define vec_load(p)     _mm256_loadu_si256((const __m256i *)(p))
+#define vec_set1(c)     _mm256_set1_epi8((char)(c))
+#define vec_eq(a, b)    _mm256_cmpeq_epi8((a), (b))
+#define vec_or(a, b)    _mm256_or_si256((a), (b))
+#define vec_min_u8(a, b) _mm256_min_epu8((a), (b))
+#define vec_mask(v)     ((uint32_t)_mm256_movemask_epi8(v))
+#define vec_zero()      _mm256_setzero_si256()
+#define vec_sub(a, b)   _mm256_sub_epi8((a), (b))
+static inline uint64_t vec_sum_u8(vec_t v)
+{
+    __m256i s = _mm256_sad_epu8(v, _mm256_setzero_si256());
+    return _mm256_extract_epi64(s, 0) + _mm256_extract_epi64(s, 1)
+         + _mm256_extract_epi64(s, 2) + _mm256_extract_epi64(s, 3);
+}
+#elif defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_BLOCK 16
+typedef __m128i vec_t;
+#define vec_load(p)     _mm_loadu_si128((const __m128i *)(p))
+#define vec_set1(c)     _mm_set1_epi8((char)(c))
+#define vec_eq(a, b)    _mm_cmpeq_epi8((a), (b))
+#define vec_or(a, b)    _mm_or_si128((a), (b))
+#define vec_min_u8(a, b) _mm_min_epu8((a), (b))
+#define vec_mask(v)     ((uint32_t)_mm_movemask_epi8(v))
+#define vec_zero()      _mm_setzero_si128()
+#define vec_sub(a, b)   _mm_sub_epi8((a), (b))
+static inline uint64_t vec_sum_u8(vec_t v)
+{
+    __m128i s = _mm_sad_epu8(v, _mm_setzero_si128());
+    return (uint64_t)_mm_cvtsi128_si64(s) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(s, s));
+}
+#endif
+
+const char *scan_word(const char *p, const char *end)
+{
+#ifdef SCAN_BLOCK
+    const vec_t blank = vec_set1(' ');
+    while (end - p >= SCAN_BLOCK) {
+        vec_t v = vec_load(p);
+        vec_t hit = vec_eq(vec_min_u8(v, blank), v);  // bytes <= ' '
+#define HIT(c) hit = vec_or(hit, vec_eq(v, vec_set1(c)))
+        HIT(0x7f); HIT('!'); HIT('#'); HIT('$'); HIT('&'); HIT('\''); HIT('(');
+        HIT(')'); HIT(';'); HIT('<'); HIT('>'); HIT('\\'); HIT('{'); HIT('|'); HIT('}');
+#undef HIT
+        uint32_t mask = vec_mask(hit);
+        if (mask != 0) return p + __builtin_ctz(mask);
+        p += SCAN_BLOCK;
+    }
+#else
+    UNUSED_VAR(end);  // the caller scans byte by byte
+#endif
+    return p;
+}
+
+const char *scan_either(const char *p, const char *end, char a, char b)
+{
+#ifdef SCAN_BLOCK
+    const vec_t va = vec_set1(a), vb = vec_set1(b);
+    while (end - p >= SCAN_BLOCK) {
+        vec_t v = vec_load(p);
+        uint32_t mask = vec_mask(vec_or(vec_eq(v, va), vec_eq(v, vb)));
+        if (mask != 0) return p + __builtin_ctz(mask);
+        p += SCAN_BLOCK;
+    }
+#endif
+    while (p != end && *p != a && *p != b) ++p;
+    return p;
+}
+
+size_t scan_count(const char *p, const char *end, char c)
+{
+    size_t count = 0;
+#ifdef SCAN_BLOCK
+    // A match is a byte of -1, so subtracting counts it in its lane. Lanes
+    // are added up before any of them can pass 255.
+    const vec_t vc = vec_set1(c);
+    while (end - p >= SCAN_BLOCK) {
+        size_t blocks = (end - p) / SCAN_BLOCK;
+        if (blocks > 255) blocks = 255;
+        vec_t lanes = vec_zero();
+        for (size_t i = 0; i < blocks; ++i, p += SCAN_BLOCK) {
+            lanes = vec_sub(lanes, vec_eq(vec_load(p), vc));
+        }
+        count += vec_sum_u8(lanes);
+    }
+#endif
+    for (; p != end; ++p) count += (*p == c);
+    return count;
+}
@@ -0,0 +1,19 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+// Byte scanners used by the lexer, by quote removal and by `wc`. They look at
+// 16 or 32 bytes at a time when SSE2 or AVX2 is available at build time.
+
+// Returns the first byte in [p, end) that may need handling inside a word:
+// a blank or control character, an operator character, '#', '$', a quote or
+// a backslash. Without SIMD it may stop earlier, so the caller finishes the
+// scan byte by byte.
+const char *scan_word(const char *p, const char *end);
+
+// Returns the first occurrence of `a` or `b` in [p, end), or `end`.
+const char *scan_either(const char *p, const char *end, char a, char b);
+
+// Returns how many times `c` occurs in [p, end), as `wc -l` counts newlines.
+size_t scan_count(const char *p, const char *end, char c);
+
+#endif // SCAN_H
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lexer.h"
+#include "parser.h"
+#include "utils.h"
+#include "vm.h"
+#include "states.h"
+#include "script.h"
+#include "il_cache.h"
+#include "arena.h"
+
+// Size of the blocks read from a stream. The parser buffer holds at most the
+// command being parsed plus one block.
+static const size_t STREAM_BLOCK_SIZE = 64 * 1024;
+
+// Exit status used when a script can't be read or parsed, as other shells do.
+static const int SCRIPT_ERR_STATUS = 2;
+
+static void end_command(vm_t *vm, parser_t *parser)
+{
+    vm_clear(vm);
+    parser_release_tokens(parser);
+    arena_reset(&line_arena);
+}
+
+// Parses and executes one complete command at a time, so that aliases defined
+// by a command apply to the following lines, and a syntax error only stops
+// the commands after it.
+static int script_exec(vm_t *vm, parser_t *parser)
+{
+    il_list_t *ils = parser_il_list(parser);
+    while (true) {
+        const char *line, *line_end;
+        if (parser_next_line(parser, &line, &line_end)) {
+            il_list_t *cached = il_cache_get(line, line_end);
+            if (cached != NULL) {
+                parser_skip_line(parser);
+                vm_clear(vm);
+                vm_exec(vm, cached);
+                end_command(vm, parser);
+                parser_discard(parser);
+                continue;
+            }
+        }
+
+        ptrdiff_t begin = parser_tell(parser);
+        token_t *peek = get_token(parser, LEX_HINT_CMD_PREFIX_KW);
+        if (peek == NULL) return SCRIPT_ERR_STATUS;
+        if (peek->type == TOKEN_NEWLINE) {
+            free_token(parser, peek);
+            continue;
+        }
+        if (peek->type == TOKEN_EOF) {
+            free_token(parser, peek);
+            break;
+        }
+
+        token_t *subpeek = parse_complete_command(parser, peek);
+        // A command ends at a newline or at the end of the input. Anything
+        // else, like a keyword of a compound command, was left unparsed, and
+        // nothing of the line may run.
+        const token_t *last = subpeek != NULL ? subpeek : peek;
+        bool complete = last->type == TOKEN_NEWLINE || last->type == TOKEN_EOF;
+        if (subpeek != NULL) free_token(parser, subpeek);
+        free_token(parser, peek);
+        if (state_debug) parser_dump(parser);
+        if (parser_error(parser) != PARSER_NO_ERROR) {
+            fprintf(stderr, "nsh: parser: %s\n", parser_strerror(parser));
+            return SCRIPT_ERR_STATUS;
+        }
+        if (!complete) {
+            fputs("nsh: parser: Unexpected input\n", stderr);
+            return SCRIPT_ERR_STATUS;
+        }
+
+        il_list_optimize(ils);
+        ptrdiff_t end = parser_tell(parser);
+        if (begin >= 0 && end >= 0) {
+            il_cache_put(parser_text(parser, begin), parser_text(parser, end), ils);
+        }
+        vm_clear(vm);
+        vm_exec(vm, ils);
+        end_command(vm, parser);
+        if (!il_list_clear(ils)) return SCRIPT_ERR_STATUS;
+        parser_discard(parser);
+    }
+    return vm_status(vm);
+}
+
+int script_exec_file(vm_t *vm, const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "nsh: %s: %s\n", path, strerror(errno));
+        return SCRIPT_ERR_STATUS;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "nsh: %s: %s\n", path, strerror(errno));
+        close(fd);
+        return SCRIPT_ERR_STATUS;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return EXIT_SUCCESS;
+    }
+
+    size_t len = (size_t)st.st_size;
+    char *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "nsh: %s: %s\n", path, strerror(errno));
+        return SCRIPT_ERR_STATUS;
+    }
+    madvise(map, len, MADV_SEQUENTIAL);
+
+    int ret = SCRIPT_ERR_STATUS;
+    parser_t *parser = parser_new_view(map, map + len);
+    if (parser != NULL) {
+        ret = script_exec(vm, parser);
+        parser_free(parser);
+    }
+    munmap(map, len);
+    return ret;
+}
+
+int script_exec_string(vm_t *vm, const char *str)
+{
+    parser_t *parser = parser_new_view(str, str + strlen(str));
+    if (parser == NULL) return SCRIPT_ERR_STATUS;
+    int ret = script_exec(vm, parser);
+    parser_free(parser);
+    return ret;
+}
+
+static bool stream_refill(parser_t *parser, void *arg)
+{
+    int fd = *(int *)arg;
+    char *buff = parser_reserve(parser, STREAM_BLOCK_SIZE);
+    if (buff == NULL) return false;
+
+    ssize_t len;
+    do {
+        len = read(fd, buff, STREAM_BLOCK_SIZE);
+    } while (len < 0 && errno == EINTR);
+    if (len < 0) perror("nsh: read");
+    if (len <= 0) return false;
+
+    parser_commit(parser, (size_t)len);
+    return true;
+}
+
+// Executes commands as they arrive from `fd`, dropping the input of each one
+// once it has run, so memory use doesn't depend on the size of the stream.
+int script_exec_stream(vm_t *vm, int fd)
+{
+    parser_t *parser = parser_new("", "");
+    if (parser == NULL) return SCRIPT_ERR_STATUS;
+    parser_set_refill(parser, &stream_refill, &fd);
+    parser_set_streaming(parser, true);
+    int ret = script_exec(vm, parser);
+    parser_free(parser);
+    return ret;
+}
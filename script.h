@@ -0,0 +1,10 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+typedef struct vm_s vm_t;
+
+int script_exec_file(vm_t *vm, const char *path);
+int script_exec_string(vm_t *vm, const char *str);
+int script_exec_stream(vm_t *vm, int fd);
+
+#endif // SCRIPT_H
@@ -1,4 +1,5 @@
 #include "states.h"
 
 bool state_debug = false;
+bool state_uncat = true;
 state_debug_level_t state_debug_level = DEBUG_NORMAL;
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 
 extern bool state_debug;
+extern bool state_uncat;  // `cat FILE | cmd` runs cmd on FILE itself, see exec.c
 
 typedef enum state_debug_level_e {
     DEBUG_IL_ONLY,  // Only generates IL, won't feed them to the VM
@@ -4,6 +4,9 @@
 #define _XOPEN_SOURCE 500
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
 #include <stdarg.h>
 #include <ctype.h>
 #include <limits.h>
@@ -11,6 +14,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <pwd.h>
+#include "scan.h"
 
 void panic(const char *reason)
 {
@@ -90,7 +94,7 @@ char *tilde_expand(const char *s)
     char *str = strdup(s);
     if (str == NULL) return NULL;
     char *path_begin = str + 1;
-    if (*path_begin != '/') {
+    if (*path_begin != '/' && *path_begin != '\0') {
         ++path_begin;
         while (*path_begin != '\0' && *path_begin != '/') ++path_begin;
         if (*path_begin != '\0') {
@@ -121,3 +125,51 @@ char *tilde_expand(const char *s)
     free(str);
     return new_str;
 }
+
+// Copies `src` to `dst` without quotes and escaping backslashes. `dst` must be
+// at least as large as `src`. Returns the end of the NUL-terminated result.
+char *remove_quotes(char *dst, const char *src, size_t len)
+{
+    const char *p = src, *end = src + len;
+    while (p != end) {
+        const char *special = scan_either(p, end, '\'', '\\');
+        memcpy(dst, p, special - p);
+        dst += special - p;
+        p = special;
+        if (p == end) break;
+
+        if (*p == '\'') {
+            const char *close = memchr(p + 1, '\'', end - p - 1);
+            if (close == NULL) close = end;
+            memcpy(dst, p + 1, close - p - 1);
+            dst += close - p - 1;
+            p = (close == end) ? end : close + 1;
+        } else if (p + 1 == end) {
+            p = end;
+        } else {
+            if (p[1] != '\n') *dst++ = p[1];  // else a line continuation
+            p += 2;
+        }
+    }
+    *dst = '\0';
+    return dst;
+}
+
+// Monotonic clock for the counters shown by `debug stats`
+uint64_t now_nsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// FNV-1a, for the hash tables keyed by strings
+uint32_t str_hash(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
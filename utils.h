@@ -1,6 +1,9 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 void panic(const char *reason);
 
 char *str_join(const char *init, const char *sep, const char *follow);
@@ -11,6 +14,10 @@ void print_str_repr(const char *str, int max_len);
 void init_env(void);
 
 char *tilde_expand(const char *str);
+char *remove_quotes(char *dst, const char *src, size_t len);
+
+uint64_t now_nsec(void);
+uint32_t str_hash(const char *str, size_t len);
 
 #define UNUSED_VAR(x) (void)(x)
 
@@ -0,0 +1,321 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include "var.h"
+#include "utils.h"
+
+typedef struct var_s {
+    char *name;
+    char *value;
+    char *env;          // "name=value" while exported, built on demand
+    int env_index;      // position of env in env_array, or -1
+    unsigned flags;
+    unsigned long generation;  // bumped whenever the variable changes
+} var_t;
+
+static var_t *vars = NULL;
+static int vars_count = 0, vars_capacity = 0;
+
+// Open addressing index from names to slots
+static int32_t *index_slots = NULL;
+static uint32_t index_capacity = 0;
+
+// The environment is rebuilt from the exported variables only when a command
+// needs it and env_generation has moved past the one env_array was built at.
+// Only the strings of changed variables are joined again. Strings replaced in
+// the meantime are kept until then, since env_array and maybe `environ` still
+// point to them.
+extern char **environ;
+static char **env_array = NULL;
+static int env_array_count = 0;
+static unsigned long env_generation = 1, env_array_generation = 0;
+static char **retired = NULL;
+static int retired_count = 0, retired_capacity = 0;
+
+static bool valid_slot(int slot)
+{
+    return slot >= 0 && slot < vars_count;
+}
+
+static bool index_rehash(void)
+{
+    uint32_t new_cap = index_capacity < 64 ? 64 : index_capacity * 2;
+    int32_t *new_index = malloc(new_cap * sizeof(int32_t));
+    if (new_index == NULL) return false;
+    for (uint32_t i = 0; i < new_cap; ++i) new_index[i] = -1;
+    for (int slot = 0; slot < vars_count; ++slot) {
+        uint32_t i = str_hash(vars[slot].name, strlen(vars[slot].name)) & (new_cap - 1);
+        while (new_index[i] >= 0) i = (i + 1) & (new_cap - 1);
+        new_index[i] = slot;
+    }
+    free(index_slots);
+    index_slots = new_index;
+    index_capacity = new_cap;
+    return true;
+}
+
+static int var_find(const char *name, size_t len, uint32_t *pos)
+{
+    if (index_capacity == 0) return -1;
+    uint32_t i = str_hash(name, len) & (index_capacity - 1);
+    for (; index_slots[i] >= 0; i = (i + 1) & (index_capacity - 1)) {
+        const char *other = vars[index_slots[i]].name;
+        if (strncmp(other, name, len) == 0 && other[len] == '\0') return index_slots[i];
+    }
+    if (pos != NULL) *pos = i;
+    return -1;
+}
+
+// Returns the slot of the variable `name`, adding an unset one if needed, or
+// -1 if out of memory.
+int var_intern(const char *name, size_t len)
+{
+    int slot = var_find(name, len, NULL);
+    if (slot >= 0) return slot;
+
+    if ((uint32_t)(vars_count + 1) * 2 > index_capacity && !index_rehash()) return -1;
+    if (vars_count == vars_capacity) {
+        int new_cap = vars_capacity < 64 ? 64 : vars_capacity * 2;
+        var_t *new_vars = realloc(vars, new_cap * sizeof(var_t));
+        if (new_vars == NULL) return -1;
+        vars = new_vars;
+        vars_capacity = new_cap;
+    }
+    char *copy = malloc(len + 1);
+    if (copy == NULL) return -1;
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+
+    uint32_t pos;
+    var_find(name, len, &pos);
+    slot = vars_count++;
+    vars[slot].name = copy;
+    vars[slot].value = NULL;
+    vars[slot].env = NULL;
+    vars[slot].env_index = -1;
+    vars[slot].flags = 0;
+    vars[slot].generation = 0;
+    index_slots[pos] = slot;
+    return slot;
+}
+
+static void retire(char *str)
+{
+    if (str == NULL) return;
+    if (retired_count == retired_capacity) {
+        int new_cap = retired_capacity < 16 ? 16 : retired_capacity * 2;
+        char **new_retired = realloc(retired, new_cap * sizeof(char *));
+        if (new_retired == NULL) panic("Can't allocate environment");
+        retired = new_retired;
+        retired_capacity = new_cap;
+    }
+    retired[retired_count++] = str;
+}
+
+static void var_changed(var_t *var)
+{
+    ++var->generation;
+    if (var->env == NULL && !(var->flags & VAR_EXPORT)) return;
+    retire(var->env);
+    var->env = NULL;
+    ++env_generation;
+}
+
+// Imports the environment. Call once at startup.
+void var_init(void)
+{
+    for (char **e = environ; *e != NULL; ++e) {
+        const char *eq = strchr(*e, '=');
+        if (eq == NULL) continue;
+        int slot = var_intern(*e, eq - *e);
+        if (slot < 0 || !var_set(slot, eq + 1)) panic("Can't import environment");
+        vars[slot].flags |= VAR_EXPORT;
+    }
+}
+
+const char *var_name(int slot)
+{
+    return valid_slot(slot) ? vars[slot].name : NULL;
+}
+
+// Returns NULL if the variable is unset.
+const char *var_get(int slot)
+{
+    return valid_slot(slot) ? vars[slot].value : NULL;
+}
+
+unsigned var_flags(int slot)
+{
+    return valid_slot(slot) ? vars[slot].flags : 0;
+}
+
+// Writes the canonical form of the decimal integer `str` into `buff`, which
+// must hold at least 21 characters. An empty string counts as 0.
+static bool to_integer(const char *str, char *buff)
+{
+    char *end;
+    errno = 0;
+    long long n = strtoll(str, &end, 10);
+    while (*end == ' ' || *end == '\t') ++end;
+    if (errno != 0 || *end != '\0') return false;
+    sprintf(buff, "%lld", n);
+    return true;
+}
+
+bool var_set(int slot, const char *value)
+{
+    if (!valid_slot(slot)) return false;
+    var_t *var = &vars[slot];
+    if (var->flags & VAR_READONLY) {
+        fprintf(stderr, "nsh: %s: readonly variable\n", var->name);
+        return false;
+    }
+    char buff[32];
+    if (var->flags & VAR_INTEGER) {
+        if (!to_integer(value, buff)) {
+            fprintf(stderr, "nsh: %s: %s: not an integer\n", var->name, value);
+            return false;
+        }
+        value = buff;
+    }
+    size_t len = strlen(value);
+    char *copy = malloc(len + 1);
+    if (copy == NULL) return false;
+    memcpy(copy, value, len + 1);
+    free(var->value);
+    var->value = copy;
+    var->flags |= VAR_SET;
+    var_changed(var);
+    return true;
+}
+
+bool var_unset(int slot)
+{
+    if (!valid_slot(slot)) return false;
+    var_t *var = &vars[slot];
+    if (var->flags & VAR_READONLY) {
+        fprintf(stderr, "nsh: %s: readonly variable\n", var->name);
+        return false;
+    }
+    free(var->value);
+    var->value = NULL;
+    var->flags &= ~VAR_SET;
+    var_changed(var);
+    return true;
+}
+
+bool var_export(int slot, bool export)
+{
+    if (!valid_slot(slot)) return false;
+    var_t *var = &vars[slot];
+    if (export) var->flags |= VAR_EXPORT;
+    var_changed(var);
+    if (!export) var->flags &= ~VAR_EXPORT;
+    return true;
+}
+
+// Adds VAR_READONLY and VAR_INTEGER attributes. Making a variable integer
+// fails if its current value isn't one.
+bool var_add_flags(int slot, unsigned flags)
+{
+    if (!valid_slot(slot)) return false;
+    var_t *var = &vars[slot];
+    flags &= VAR_READONLY | VAR_INTEGER;
+    if ((flags & VAR_INTEGER) && !(var->flags & VAR_INTEGER) && var->value != NULL) {
+        unsigned readonly = var->flags & VAR_READONLY;
+        var->flags = (var->flags & ~VAR_READONLY) | VAR_INTEGER;
+        bool ok = var_set(slot, var->value);
+        var->flags = (var->flags & ~VAR_INTEGER) | readonly | (ok ? VAR_INTEGER : 0);
+        if (!ok) return false;
+    }
+    var->flags |= flags;
+    return true;
+}
+
+// Lets caches built from a variable's value notice when it changes.
+unsigned long var_generation(int slot)
+{
+    return valid_slot(slot) ? vars[slot].generation : 0;
+}
+
+const char *var_lookup(const char *name)
+{
+    return var_get(var_find(name, strlen(name), NULL));
+}
+
+bool var_put(const char *name, const char *value)
+{
+    int slot = var_intern(name, strlen(name));
+    return slot >= 0 && var_set(slot, value);
+}
+
+int var_count(void)
+{
+    return vars_count;
+}
+
+// Returns the environment for commands, rebuilding it if an exported variable
+// has changed since the last call.
+char **var_environ(void)
+{
+    if (env_array_generation == env_generation) return env_array;
+
+    int count = 0;
+    for (int slot = 0; slot < vars_count; ++slot) {
+        var_t *var = &vars[slot];
+        if (!(var->flags & VAR_EXPORT) || var->value == NULL) continue;
+        if (var->env == NULL) {
+            var->env = str_join(var->name, "=", var->value);
+            if (var->env == NULL) panic("Can't allocate environment");
+        }
+        ++count;
+    }
+
+    char **new_array = malloc((count + 1) * sizeof(char *));
+    if (new_array == NULL) panic("Can't allocate environment");
+    int i = 0;
+    for (int slot = 0; slot < vars_count; ++slot) {
+        var_t *var = &vars[slot];
+        if (var->env != NULL && var->value != NULL) {
+            var->env_index = i;
+            new_array[i++] = var->env;
+        } else {
+            var->env_index = -1;
+        }
+    }
+    new_array[i] = NULL;
+
+    if (environ == env_array) environ = new_array;
+    free(env_array);
+    for (int i = 0; i < retired_count; ++i) free(retired[i]);
+    retired_count = 0;
+    env_array = new_array;
+    env_array_count = count;
+    env_array_generation = env_generation;
+    return env_array;
+}
+
+int var_environ_count(void)
+{
+    var_environ();
+    return env_array_count;
+}
+
+// Returns where the variable is in var_environ(), or -1 if it isn't there, so
+// that a command's own assignments can replace entries without a search.
+int var_environ_index(int slot)
+{
+    var_environ();
+    return valid_slot(slot) ? vars[slot].env_index : -1;
+}
+
+// Points `environ` at the exported variables, for code outside the shell that
+// reads it, e.g. readline. Commands get var_environ() directly.
+void var_sync_environ(void)
+{
+    environ = var_environ();
+}
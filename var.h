@@ -0,0 +1,35 @@
+#ifndef VAR_H
+#define VAR_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef enum var_flag_e {
+    VAR_SET      = 1 << 0,  // has a value, even an empty one
+    VAR_EXPORT   = 1 << 1,  // passed to commands in their environment
+    VAR_READONLY = 1 << 2,
+    VAR_INTEGER  = 1 << 3,  // values are checked and stored as decimal integers
+} var_flag_t;
+
+// Shell variables live in a dense array. Names are interned into slot
+// indices when a command is compiled, so expanding a variable is an array
+// access. Slots are never reused, so IL holding them stays valid.
+void var_init(void);
+int var_intern(const char *name, size_t len);
+const char *var_name(int slot);
+const char *var_get(int slot);
+unsigned var_flags(int slot);
+bool var_set(int slot, const char *value);
+bool var_unset(int slot);
+bool var_export(int slot, bool export);
+bool var_add_flags(int slot, unsigned flags);
+unsigned long var_generation(int slot);
+const char *var_lookup(const char *name);
+bool var_put(const char *name, const char *value);
+int var_count(void);
+char **var_environ(void);
+int var_environ_count(void);
+int var_environ_index(int slot);
+void var_sync_environ(void);
+
+#endif // VAR_H
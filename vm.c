@@ -10,19 +10,25 @@
 #include "vm_entry.h"
 #include "vm_stack.h"
 #include "vm.h"
-#include "cfuhash.h"
 #include "il_t.inc.h"
 #include "utils.h"
 #include "exec.h"
 #include "states.h"
+#include "var.h"
 #include <reader.h>
 
 typedef struct vm_s {
     vm_stack_t stack;
-    cfuhash_table_t *assigns;
     int recent_ret;
 } vm_t;
 
+// Shown by `debug stats`
+static struct {
+    uint64_t instructions;
+    uint64_t dispatch_nsec;  // time in vm_exec, excluding exec_nsec
+    uint64_t exec_nsec;      // time running commands, in the current vm_exec
+} vm_stats;
+
 const char *vm_error_name(vm_error_t vme)
 {
     switch (vme) {
@@ -52,18 +58,12 @@ vm_t *vm_new(void)
     vm_t *vm = malloc(sizeof(vm_t));
     if (vm == NULL) return NULL;
 
-    vm->assigns = cfuhash_new();
-    if (vm->assigns == NULL) {
-        free(vm);
-        return NULL;
-    }
-
+    vm->recent_ret = 0;
     vm->stack.entries = NULL;
     vm->stack.capacity = 0;
     vm->stack.size = 0;
 
     if (!vm_stack_init(&vm->stack)) {
-        cfuhash_destroy(vm->assigns);
         free(vm);
         return NULL;
     }
@@ -74,20 +74,20 @@ vm_t *vm_new(void)
 void vm_free(vm_t *vm)
 {
     if (vm == NULL) return;
-    if (vm->assigns != NULL) cfuhash_destroy(vm->assigns);
     vm_stack_free(&vm->stack);
     free(vm);
 }
 
 bool vm_valid(vm_t *vm)
 {
-    return vm != NULL && vm->assigns != NULL && vm_stack_valid(&vm->stack);
+    return vm != NULL && vm_stack_valid(&vm->stack);
 }
 
 bool vm_clear(vm_t *vm)
 {
-    vm_stack_free(&vm->stack);
-    return vm_stack_init(&vm->stack);
+    if (!vm_valid(vm)) return false;
+    vm_stack_clear(&vm->stack);
+    return true;
 }
 
 static vm_error_t vm_try_push(vm_t *vm, vm_entry_t *e)
@@ -120,6 +120,7 @@ static vm_error_t vm_push_int(vm_t *vm, il_type_t type, int payload)
     switch (type) {
     case IL_PUSH_FD:    etype = VM_ENTRY_FD; break;
     case IL_PUSH_REDIR: etype = VM_ENTRY_REDIR; break;
+    case IL_PUSH_HOLE:  etype = VM_ENTRY_HOLE;  break;
     default: return VM_ERR_INTERNAL;
     }
     vm_entry_t *e = make_vm_entry_int(etype, payload);
@@ -131,7 +132,8 @@ static vm_error_t vm_push_str(vm_t *vm, il_type_t type, const char *payload)
     vm_entry_type_t etype;
     switch (type) {
     case IL_PUSH_PARTIAL: etype = VM_ENTRY_PARTIAL; break;
-    case IL_PUSH_NAME:    etype = VM_ENTRY_NAME;    break;
+    case IL_PUSH_WORD:    etype = VM_ENTRY_WORD;    break;
+    case IL_PUSH_ASSIGN:  return vm_try_push(vm, make_vm_entry_assign_word(payload));
     default: return VM_ERR_INTERNAL;
     }
     vm_entry_t *e = make_vm_entry_str(etype, payload);
@@ -199,24 +201,26 @@ static vm_error_t vm_compose_command(vm_t *vm)
         return VM_ERR_OVERFLOW;
     }
 
-    vm_entry_command_t *command = malloc(sizeof(vm_entry_command_t));
+    vm_entry_command_t *command = vm_entry_alloc(sizeof(vm_entry_command_t));
     if (command == NULL) return VM_ERR_INTERNAL;
     command->type = VM_ENTRY_COMMAND;
     command->pipe_in = command->pipe_out = -1;
+    command->tmpl = NULL;
 
     size_t args_size = sizeof(vm_entry_str_t *) * (arg_count + 1);
     size_t assigns_size = sizeof(vm_entry_assign_t *) * (assign_count + 1);
     size_t ioredirs_size = sizeof(vm_entry_ioredir_t *) * (ioredir_count + 1);
 
-    vm_entry_str_t **args = malloc(args_size);
-    vm_entry_assign_t **assigns = malloc(assigns_size);
-    vm_entry_ioredir_t **ioredirs = malloc(ioredirs_size);
+    vm_entry_str_t **args = vm_entry_alloc(args_size);
+    vm_entry_assign_t **assigns = vm_entry_alloc(assigns_size);
+    vm_entry_ioredir_t **ioredirs = vm_entry_alloc(ioredirs_size);
 
     if (args == NULL || assigns == NULL || ioredirs == NULL) {
-        if (args != NULL)     free(args);
-        if (assigns != NULL)  free(assigns);
-        if (ioredirs != NULL) free(ioredirs);
-        free(command);
+        vm_entry_release(args);
+        vm_entry_release(assigns);
+        vm_entry_release(ioredirs);
+        vm_entry_release(command);
+        return VM_ERR_INTERNAL;
     }
 
     for (int i = 0; i <= arg_count; ++i) args[i] = NULL;
@@ -320,26 +324,13 @@ static vm_error_t vm_compose_word(vm_t *vm)
     }
 
     bool tilde = ((vm_entry_str_t *)(vm->stack.entries[word_init_i + 1]))->pl_str[0] == '~';
-    vm_entry_str_t *word = malloc(sizeof(vm_entry_str_t) + (size_t)total_len + 1);
+    vm_entry_str_t *word = vm_entry_alloc(sizeof(vm_entry_str_t) + (size_t)total_len + 1);
     if (word == NULL) return VM_ERR_INTERNAL;
     word->type = VM_ENTRY_WORD;
     char *payload = word->pl_str;
     for (int i = word_init_i + 1; i < vm->stack.size; ++i) {
         vm_entry_str_t *e = (vm_entry_str_t *)(vm->stack.entries[i]);
-
-        bool single_quote = false, backslash = false;
-        for (const char *p = e->pl_str; *p != '\0'; ++p) {
-            if (*p == '\'' && (single_quote || !backslash)) {
-                single_quote = !single_quote;
-            } else if (*p == '\\' && single_quote == false && backslash == false) {
-                backslash = true;
-            } else {
-                backslash = false;
-                *payload++ = *p;
-            }
-        }
-        *payload = '\0';
-
+        payload = remove_quotes(payload, e->pl_str, strlen(e->pl_str));
         free_vm_entry((vm_entry_t *)e);
     }
     word->pl_str[total_len] = '\0';
@@ -347,11 +338,13 @@ static vm_error_t vm_compose_word(vm_t *vm)
     while (tilde) {
         char *path = tilde_expand(word->pl_str);
         if (path == NULL) break;
-        vm_entry_str_t *new_word = realloc(word, sizeof(vm_entry_str_t) + strlen(path) + 1);
+        vm_entry_str_t *new_word = vm_entry_alloc(sizeof(vm_entry_str_t) + strlen(path) + 1);
         if (new_word == NULL) {
             free(path);
             break;
         }
+        new_word->type = VM_ENTRY_WORD;
+        vm_entry_release(word);
         word = new_word;
         strcpy(word->pl_str, path);
         free(path);
@@ -372,13 +365,16 @@ static vm_error_t vm_exec_background(vm_t *vm)
     vm_entry_t *e = vm_stack_pop(&vm->stack);
     if (e == NULL) return VM_ERR_INTERNAL;
 
+    uint64_t begin = now_nsec();
     switch (e->type) {
     case VM_ENTRY_COMMAND:
         exec_command((vm_entry_command_t *)e, NULL, BACKGROUND);
+        vm_stats.exec_nsec += now_nsec() - begin;
         free_vm_entry(e);
         return VM_NO_ERROR;
     case VM_ENTRY_PIPELINE:
         exec_pipeline((vm_entry_pipeline_t *)e, NULL, BACKGROUND);
+        vm_stats.exec_nsec += now_nsec() - begin;
         free_vm_entry(e);
         return VM_NO_ERROR;
     default:
@@ -391,8 +387,11 @@ static void add_assigns(vm_t *vm, vm_entry_command_t *e)
     if (e->assigns == NULL) return;
     for (vm_entry_assign_t **pa = e->assigns; *pa != NULL; ++pa) {
         vm_entry_assign_t *a = *pa;
-        void *old = cfuhash_put(vm->assigns, a->pl_name, strdup(a->pl_val));
-        if (old != NULL) free(old);
+        int slot = var_intern(a->pl_name, strlen(a->pl_name));
+        if (slot < 0 || !var_set(slot, a->pl_val)) {
+            vm->recent_ret = 1;
+            continue;
+        }
         if (strcmp(a->pl_name, "HISTSIZE") == 0) {
             reader_set_histsize(a->pl_val);
         }
@@ -404,6 +403,7 @@ static vm_error_t vm_exec_pipeline(vm_t *vm)
     vm_entry_t *e = vm_stack_pop(&vm->stack);
     if (e == NULL) return VM_ERR_INTERNAL;
 
+    uint64_t begin = now_nsec();
     switch (e->type) {
     case VM_ENTRY_COMMAND: {
         vm_entry_command_t *c = (vm_entry_command_t *)e;
@@ -411,11 +411,13 @@ static vm_error_t vm_exec_pipeline(vm_t *vm)
             add_assigns(vm, c);
         } else {
             exec_command((vm_entry_command_t *)e, &vm->recent_ret, FOREGROUND);
+            vm_stats.exec_nsec += now_nsec() - begin;
         }
         free_vm_entry(e);
         return VM_NO_ERROR;
     } case VM_ENTRY_PIPELINE:
         exec_pipeline((vm_entry_pipeline_t *)e, &vm->recent_ret, FOREGROUND);
+        vm_stats.exec_nsec += now_nsec() - begin;
         free_vm_entry(e);
         return VM_NO_ERROR;
     default:
@@ -423,29 +425,10 @@ static vm_error_t vm_exec_pipeline(vm_t *vm)
     }
 }
 
-static vm_error_t vm_expand_param(vm_t *vm)
+static vm_error_t vm_expand_var(vm_t *vm, int slot)
 {
-    vm_entry_str_t *e = (vm_entry_str_t *)(vm_stack_pop(&vm->stack));
-    if (e == NULL || e->type != VM_ENTRY_NAME) return VM_ERR_TYPE_MISMATCH;
-
-    const char *partial = NULL;
-    if (cfuhash_exists(vm->assigns, e->pl_str)) {
-        partial = cfuhash_get(vm->assigns, e->pl_str);
-    } else if (getenv(e->pl_str) != NULL) {
-        partial = getenv(e->pl_str);
-    }
-    if (partial == NULL) partial = "";
-
-    free_vm_entry((vm_entry_t *)e);
-    vm_entry_t *ne = make_vm_entry_str(VM_ENTRY_PARTIAL, partial);
-    if (ne == NULL) return VM_ERR_INTERNAL;
-
-    if (!vm_stack_push(&vm->stack, ne)) {
-        free_vm_entry(ne);
-        return VM_ERR_INTERNAL;
-    }
-
-    return VM_NO_ERROR;
+    const char *value = var_get(slot);
+    return vm_try_push(vm, make_vm_entry_str(VM_ENTRY_PARTIAL, value != NULL ? value : ""));
 }
 
 static vm_error_t vm_pipeline_link(vm_t *vm)
@@ -474,9 +457,146 @@ static vm_error_t vm_pipeline_link(vm_t *vm)
     return VM_NO_ERROR;
 }
 
-vm_error_t vm_exec1(vm_t *vm, il_t *il)
+static void free_template_slot(void *t)
+{
+    free_vm_template((vm_template_t *)t);
+}
+
+// Whether the template after the JUMP_IF_FROZEN at `pc` is frozen. If not,
+// entries are allocated on the heap until it is, since it outlives the line.
+static bool vm_template_frozen(il_list_t *ils, int pc)
+{
+    int skip = il_int_at(ils, pc);
+    int slot = il_int_at(ils, pc + skip - il_length(IL_FREEZE_TEMPLATE));
+    void **t = il_list_slot(ils, slot, free_template_slot);
+    if (t != NULL && *t != NULL) return true;
+    vm_entry_alloc_on_heap(true);
+    return false;
+}
+
+static vm_error_t vm_freeze_template(vm_t *vm, il_list_t *ils, int slot)
+{
+    vm_entry_alloc_on_heap(false);
+    void **slot_ptr = il_list_slot(ils, slot, free_template_slot);
+    if (slot_ptr == NULL) return VM_ERR_INTERNAL;
+
+    int cmd_init_i;
+    int arg_count = 0, assign_count = 0, redir_count = 0, hole_count = 0;
+    for (cmd_init_i = vm->stack.size - 1; cmd_init_i >= 0; --cmd_init_i) {
+        vm_entry_t *e = vm->stack.entries[cmd_init_i];
+        if (e->type == VM_ENTRY_WORD) {
+            ++arg_count;
+        } else if (e->type == VM_ENTRY_ASSIGN_WORD) {
+            ++assign_count;
+        } else if (e->type == VM_ENTRY_IOREDIR) {
+            ++redir_count;
+        } else if (e->type == VM_ENTRY_HOLE) {
+            ++hole_count;
+            switch (((vm_entry_int_t *)e)->pl_int) {
+            case IL_HOLE_ARG:    ++arg_count;    break;
+            case IL_HOLE_ASSIGN: ++assign_count; break;
+            case IL_HOLE_REDIR:  ++redir_count;  break;
+            default: return VM_ERR_INVALID_VALUE;
+            }
+        } else {
+            break;
+        }
+    }
+    if (cmd_init_i < 0) return VM_ERR_TYPE_MISMATCH;
+    VM_ENTRY_ASSERT(vm->stack.entries[cmd_init_i], VM_ENTRY_CMDINIT);
+
+    vm_template_t *t = malloc(sizeof(vm_template_t) + sizeof(struct vm_hole_s) * hole_count);
+    if (t == NULL) return VM_ERR_INTERNAL;
+    vm_entry_command_t *command = &t->command;
+    command->type = VM_ENTRY_COMMAND;
+    command->args = calloc(arg_count + 1, sizeof(vm_entry_str_t *));
+    command->assigns = calloc(assign_count + 1, sizeof(vm_entry_assign_t *));
+    command->redirs = calloc(redir_count + 1, sizeof(vm_entry_ioredir_t *));
+    command->pipe_in = command->pipe_out = -1;
+    command->tmpl = t;
+    t->arg_count = arg_count;
+    t->assign_count = assign_count;
+    t->redir_count = redir_count;
+    t->hole_count = hole_count;
+    if (command->args == NULL || command->assigns == NULL || command->redirs == NULL) {
+        free_vm_template(t);
+        return VM_ERR_INTERNAL;
+    }
+
+    int arg_i = 0, ass_i = 0, ior_i = 0, hole_i = 0;
+    for (int i = cmd_init_i + 1; i < vm->stack.size; ++i) {
+        vm_entry_t *e = vm->stack.entries[i];
+        switch (e->type) {
+        case VM_ENTRY_WORD:
+            command->args[arg_i++] = (vm_entry_str_t *)e;
+            break;
+        case VM_ENTRY_ASSIGN_WORD:
+            command->assigns[ass_i++] = (vm_entry_assign_t *)e;
+            break;
+        case VM_ENTRY_IOREDIR:
+            command->redirs[ior_i++] = (vm_entry_ioredir_t *)e;
+            break;
+        default: {  // VM_ENTRY_HOLE
+            il_hole_t type = (il_hole_t)((vm_entry_int_t *)e)->pl_int;
+            t->holes[hole_i].type = type;
+            t->holes[hole_i++].index = type == IL_HOLE_ARG ? arg_i++
+                                     : type == IL_HOLE_ASSIGN ? ass_i++ : ior_i++;
+            free_vm_entry(e);
+            break;
+        }
+        }
+    }
+    free_vm_entry(vm->stack.entries[cmd_init_i]);
+    vm->stack.size = cmd_init_i;
+
+    if (*slot_ptr != NULL) free_vm_template(*slot_ptr);
+    *slot_ptr = t;
+    return VM_NO_ERROR;
+}
+
+static vm_error_t vm_compose_template(vm_t *vm, il_list_t *ils, int slot)
+{
+    void **slot_ptr = il_list_slot(ils, slot, free_template_slot);
+    if (slot_ptr == NULL || *slot_ptr == NULL) return VM_ERR_INTERNAL;
+    vm_template_t *t = *slot_ptr;
+    vm_entry_command_t *command = &t->command;
+
+    int first = vm->stack.size - t->hole_count;
+    if (first < 0) return VM_ERR_TYPE_MISMATCH;
+    for (int i = 0; i < t->hole_count; ++i) {
+        vm_entry_t *e = vm->stack.entries[first + i];
+        static const vm_entry_type_t hole_types[] = {
+            [IL_HOLE_ARG] = VM_ENTRY_WORD,
+            [IL_HOLE_ASSIGN] = VM_ENTRY_ASSIGN_WORD,
+            [IL_HOLE_REDIR] = VM_ENTRY_IOREDIR,
+        };
+        if (e->type != hole_types[t->holes[i].type]) return VM_ERR_TYPE_MISMATCH;
+    }
+    for (int i = 0; i < t->hole_count; ++i) {
+        vm_entry_t *e = vm->stack.entries[first + i];
+        int index = t->holes[i].index;
+        switch (t->holes[i].type) {
+        case IL_HOLE_ARG:    command->args[index] = (vm_entry_str_t *)e;       break;
+        case IL_HOLE_ASSIGN: command->assigns[index] = (vm_entry_assign_t *)e; break;
+        case IL_HOLE_REDIR:  command->redirs[index] = (vm_entry_ioredir_t *)e; break;
+        }
+    }
+    vm->stack.size = first;
+
+    if (!vm_stack_push(&vm->stack, (vm_entry_t *)command)) {
+        free_vm_entry_command(command);
+        return VM_ERR_INTERNAL;
+    }
+    return VM_NO_ERROR;
+}
+
+// Executes the IL at `*pc` and moves `*pc` to the next one.
+vm_error_t vm_exec1(vm_t *vm, il_list_t *ils, int *pc_ptr)
 {
-    switch (il->type) {
+    int pc = *pc_ptr;
+    il_type_t type = il_at(ils, pc);
+    *pc_ptr += il_length(type);
+    switch (type) {
     case IL_ASSIGN_WORD:
         return vm_assign_word(vm);
     case IL_COMPOSE_COMMAND:
@@ -489,55 +609,244 @@ vm_error_t vm_exec1(vm_t *vm, il_t *il)
         return vm_exec_background(vm);
     case IL_EXEC_PIPELINE:
         return vm_exec_pipeline(vm);
-    case IL_EXPAND_PARAM:
-        return vm_expand_param(vm);
     case IL_PIPELINE_LINK:
         return vm_pipeline_link(vm);
     case IL_PENDING_NOT:
     case IL_PUSH_CMDINIT:
     case IL_PUSH_WORDINIT:
-        return vm_push_no_param(vm, il->type);
-    case IL_PUSH_NAME:
+        return vm_push_no_param(vm, type);
     case IL_PUSH_PARTIAL:
-        return vm_push_str(vm, il->type, ((il_param_str_t *)il)->pl_str);
+    case IL_PUSH_WORD:
+    case IL_PUSH_ASSIGN:
+        return vm_push_str(vm, type, il_str_at(ils, pc));
     case IL_PUSH_FD:
     case IL_PUSH_REDIR:
-        return vm_push_int(vm, il->type, ((il_param_int_t *)il)->pl_int);
+    case IL_PUSH_HOLE:
+        return vm_push_int(vm, type, il_int_at(ils, pc));
+    case IL_EXPAND_VAR:
+        return vm_expand_var(vm, il_int_at(ils, pc));
+    case IL_JUMP_IF_FROZEN:
+        if (vm_template_frozen(ils, pc)) *pc_ptr = pc + il_int_at(ils, pc);
+        return VM_NO_ERROR;
+    case IL_FREEZE_TEMPLATE:
+        return vm_freeze_template(vm, ils, il_int_at(ils, pc));
+    case IL_COMPOSE_TEMPLATE:
+        return vm_compose_template(vm, ils, il_int_at(ils, pc));
     default:
         return VM_ERR_UNKNOWN_IL;
     }
 }
 
-vm_error_t vm_exec(vm_t *vm, il_list_t *ils)
+int vm_status(vm_t *vm)
 {
-    if (!vm_valid(vm) || !il_list_valid(ils)) return VM_ERR_PARAMETER;
-    if (state_debug) {
-        il_list_dump(ils);
-    }
-    for (int i = 0; i < ils->size; ++i) {
-        il_t *il = ils->array[i];
-        vm_error_t err = vm_exec1(vm, il);
-        if (state_debug) {
-            putchar('\n');
-            print_il(il);
-            vm_dump(vm);
+    return vm->recent_ret;
+}
+
+static vm_error_t vm_exec_traced(vm_t *vm, il_list_t *ils)
+{
+    il_list_dump(ils);
+    for (int next = 0; next < ils->size; ) {
+        int pc = next;
+        vm_error_t err = vm_exec1(vm, ils, &next);
+        ++vm_stats.instructions;
+        putchar('\n');
+        print_il(ils, pc);
+        vm_dump(vm);
+        if (err != VM_NO_ERROR) {
+            printf("VM error: %s (%s)\n", vm_error_name(err),
+                   il_type_name(il_at(ils, pc)));
+            return err;
         }
+    }
+    return VM_NO_ERROR;
+}
+
+#ifdef __GNUC__
+
+// Direct-threaded dispatch: every handler jumps straight to the handler of
+// the next IL, and pushes build their entries without mapping IL types to
+// entry types at run time.
+static vm_error_t vm_exec_threaded(vm_t *vm, il_list_t *ils)
+{
+    static void *const handlers[IL_TYPE_COUNT] = {
+        [IL_ASSIGN_WORD]     = &&op_assign_word,
+        [IL_COMPOSE_COMMAND] = &&op_compose_command,
+        [IL_COMPOSE_IOREDIR] = &&op_compose_ioredir,
+        [IL_COMPOSE_WORD]    = &&op_compose_word,
+        [IL_EXEC_BACKGROUND] = &&op_exec_background,
+        [IL_EXEC_PIPELINE]   = &&op_exec_pipeline,
+        [IL_PENDING_NOT]     = &&op_pending_not,
+        [IL_PIPELINE_LINK]   = &&op_pipeline_link,
+        [IL_PUSH_CMDINIT]    = &&op_push_cmdinit,
+        [IL_PUSH_WORDINIT]   = &&op_push_wordinit,
+        [IL_PUSH_PARTIAL]    = &&op_push_partial,
+        [IL_PUSH_WORD]       = &&op_push_word,
+        [IL_PUSH_ASSIGN]     = &&op_push_assign,
+        [IL_PUSH_FD]         = &&op_push_fd,
+        [IL_PUSH_REDIR]      = &&op_push_redir,
+        [IL_PUSH_HOLE]       = &&op_push_hole,
+        [IL_EXPAND_VAR]      = &&op_expand_var,
+        [IL_JUMP_IF_FROZEN]  = &&op_jump_if_frozen,
+        [IL_FREEZE_TEMPLATE] = &&op_freeze_template,
+        [IL_COMPOSE_TEMPLATE] = &&op_compose_template,
+    };
+    const uint8_t *code = ils->code;
+    const uint8_t *pc = code;
+    const uint8_t *end = code + ils->size;
+    uint64_t count = 0;
+    vm_error_t err = VM_NO_ERROR;
+
+#define OPERAND(x) memcpy(&(x), pc + 1, sizeof(x))
+#define DISPATCH(len) \
+    do { \
+        if (err != VM_NO_ERROR) goto error; \
+        pc += (len); \
+        if (pc >= end) goto done; \
+        ++count; \
+        if (*pc >= IL_TYPE_COUNT) { err = VM_ERR_UNKNOWN_IL; goto error; } \
+        goto *handlers[*pc]; \
+    } while (0)
+
+    DISPATCH(0);
+
+op_assign_word:
+    err = vm_assign_word(vm);
+    DISPATCH(1);
+op_compose_command:
+    err = vm_compose_command(vm);
+    DISPATCH(1);
+op_compose_ioredir:
+    err = vm_compose_ioredir(vm);
+    DISPATCH(1);
+op_compose_word:
+    err = vm_compose_word(vm);
+    DISPATCH(1);
+op_exec_background:
+    err = vm_exec_background(vm);
+    DISPATCH(1);
+op_exec_pipeline:
+    err = vm_exec_pipeline(vm);
+    DISPATCH(1);
+op_pending_not:
+    err = VM_ERR_NOT_IMPLEMENTED;
+    DISPATCH(1);
+op_pipeline_link:
+    err = vm_pipeline_link(vm);
+    DISPATCH(1);
+op_push_cmdinit:
+    err = vm_try_push(vm, make_vm_entry(VM_ENTRY_CMDINIT));
+    DISPATCH(1);
+op_push_wordinit:
+    err = vm_try_push(vm, make_vm_entry(VM_ENTRY_WORDINIT));
+    DISPATCH(1);
+op_push_partial: {
+        int32_t offset;
+        OPERAND(offset);
+        err = vm_try_push(vm, make_vm_entry_str(VM_ENTRY_PARTIAL, ils->pool + offset));
+    }
+    DISPATCH(1 + sizeof(int32_t));
+op_push_word: {
+        int32_t offset;
+        OPERAND(offset);
+        err = vm_try_push(vm, make_vm_entry_str(VM_ENTRY_WORD, ils->pool + offset));
+    }
+    DISPATCH(1 + sizeof(int32_t));
+op_push_assign: {
+        int32_t offset;
+        OPERAND(offset);
+        err = vm_try_push(vm, make_vm_entry_assign_word(ils->pool + offset));
+    }
+    DISPATCH(1 + sizeof(int32_t));
+op_push_fd: {
+        int32_t fd;
+        OPERAND(fd);
+        err = vm_try_push(vm, make_vm_entry_int(VM_ENTRY_FD, fd));
+    }
+    DISPATCH(1 + sizeof(int32_t));
+op_push_redir: {
+        int32_t redir;
+        OPERAND(redir);
+        err = vm_try_push(vm, make_vm_entry_int(VM_ENTRY_REDIR, redir));
+    }
+    DISPATCH(1 + sizeof(int32_t));
+op_push_hole: {
+        int32_t hole;
+        OPERAND(hole);
+        err = vm_try_push(vm, make_vm_entry_int(VM_ENTRY_HOLE, hole));
+    }
+    DISPATCH(1 + sizeof(int32_t));
+op_expand_var: {
+        int32_t slot;
+        OPERAND(slot);
+        err = vm_expand_var(vm, slot);
+    }
+    DISPATCH(1 + sizeof(int32_t));
+op_jump_if_frozen: {
+        int32_t skip;
+        OPERAND(skip);
+        DISPATCH(vm_template_frozen(ils, pc - code) ? skip : 1 + (int)sizeof(int32_t));
+    }
+op_freeze_template: {
+        int32_t slot;
+        OPERAND(slot);
+        err = vm_freeze_template(vm, ils, slot);
+    }
+    DISPATCH(1 + sizeof(int32_t));
+op_compose_template: {
+        int32_t slot;
+        OPERAND(slot);
+        err = vm_compose_template(vm, ils, slot);
+    }
+    DISPATCH(1 + sizeof(int32_t));
+
+#undef DISPATCH
+#undef OPERAND
+
+error:
+    printf("VM error: %s (%s)\n", vm_error_name(err), il_type_name(*pc));
+done:
+    vm_stats.instructions += count;
+    return err;
+}
+
+#else // __GNUC__
+
+static vm_error_t vm_exec_threaded(vm_t *vm, il_list_t *ils)
+{
+    for (int next = 0; next < ils->size; ) {
+        int pc = next;
+        vm_error_t err = vm_exec1(vm, ils, &next);
+        ++vm_stats.instructions;
         if (err != VM_NO_ERROR) {
             printf("VM error: %s (%s)\n", vm_error_name(err),
-                   il_type_name(ils->array[i]->type));
+                   il_type_name(il_at(ils, pc)));
             return err;
         }
     }
     return VM_NO_ERROR;
 }
 
-static int vm_assigns_foreach(void *key, size_t key_size, void *data, size_t data_size, void *arg)
+#endif // __GNUC__
+
+vm_error_t vm_exec(vm_t *vm, il_list_t *ils)
+{
+    if (!vm_valid(vm) || !il_list_valid(ils)) return VM_ERR_PARAMETER;
+    uint64_t begin = now_nsec();
+    vm_stats.exec_nsec = 0;
+    vm_entry_alloc_on_heap(false);
+    vm_error_t err = state_debug ? vm_exec_traced(vm, ils) : vm_exec_threaded(vm, ils);
+    uint64_t total = now_nsec() - begin;
+    // Time spent waiting for commands is not the VM's
+    vm_stats.dispatch_nsec += total > vm_stats.exec_nsec ? total - vm_stats.exec_nsec : 0;
+    return err;
+}
+
+void vm_print_stats(void)
 {
-    UNUSED_VAR(key_size); UNUSED_VAR(data_size); UNUSED_VAR(arg);
-    printf("    %s=", (char *)key);
-    print_str_repr((const char *)data, -1);
-    putchar('\n');
-    return 0;
+    double secs = vm_stats.dispatch_nsec / 1e9;
+    printf("vm: %llu instructions in %.3f ms (%.0f instructions/s)\n",
+           (unsigned long long)vm_stats.instructions, secs * 1e3,
+           secs > 0 ? vm_stats.instructions / secs : 0.0);
 }
 
 void vm_dump(vm_t *vm)
@@ -547,8 +856,14 @@ void vm_dump(vm_t *vm)
         return;
     }
     printf("<<<<<======= VM DUMP BEGIN OF %p =======<<<<<\n", vm);
-    puts("vm assigns:");
-    cfuhash_foreach(vm->assigns, &vm_assigns_foreach, NULL);
+    puts("shell variables:");
+    for (int slot = 0; slot < var_count(); ++slot) {
+        const char *value = var_get(slot);
+        if (value == NULL || (var_flags(slot) & VAR_EXPORT)) continue;
+        printf("    %s=", var_name(slot));
+        print_str_repr(value, -1);
+        putchar('\n');
+    }
     puts("vm stack:");
     for (int i = 0; i < vm->stack.size; ++i) {
         print_vm_entry(vm->stack.entries[i], 4);
@@ -22,6 +22,8 @@ void vm_free(vm_t *vm);
 bool vm_valid(vm_t *vm);
 bool vm_clear(vm_t *vm);
 vm_error_t vm_exec(vm_t *vm, il_list_t *ils);
+int vm_status(vm_t *vm);
 void vm_dump(vm_t *vm);
+void vm_print_stats(void);
 
 #endif // VM_H
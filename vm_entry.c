@@ -7,6 +7,36 @@
 #include <limits.h>
 #include "vm_entry.h"
 #include "utils.h"
+#include "arena.h"
+
+// Entries live in the line arena, except while building a template, which
+// outlives the line.
+static bool entry_on_heap = false;
+
+bool vm_entry_alloc_on_heap(bool on_heap)
+{
+    bool old = entry_on_heap;
+    entry_on_heap = on_heap;
+    return old;
+}
+
+void *vm_entry_alloc(size_t size)
+{
+    return entry_on_heap ? malloc(size) : arena_alloc(&line_arena, size);
+}
+
+void vm_entry_release(void *ptr)
+{
+    arena_release(&line_arena, ptr);
+}
+
+static char *entry_strdup(const char *str)
+{
+    size_t len = strlen(str);
+    char *copy = vm_entry_alloc(len + 1);
+    if (copy != NULL) memcpy(copy, str, len + 1);
+    return copy;
+}
 
 const char *vm_entry_type_name(vm_entry_type_t type)
 {
@@ -15,11 +45,11 @@ const char *vm_entry_type_name(vm_entry_type_t type)
     _MKENT(VM_ENTRY_CMDINIT);
     _MKENT(VM_ENTRY_WORDINIT);
     _MKENT(VM_ENTRY_PENDING_NOT);
-    _MKENT(VM_ENTRY_NAME);
     _MKENT(VM_ENTRY_PARTIAL);
     _MKENT(VM_ENTRY_FD);
     _MKENT(VM_ENTRY_REDIR);
     _MKENT(VM_ENTRY_WORD);
+    _MKENT(VM_ENTRY_HOLE);
     _MKENT(VM_ENTRY_ASSIGN_WORD);
     _MKENT(VM_ENTRY_IOREDIR);
     _MKENT(VM_ENTRY_COMMAND);
@@ -37,19 +67,18 @@ bool is_vm_entry_no_payload(vm_entry_type_t type)
 
 bool is_vm_entry_int(vm_entry_type_t type)
 {
-    return type == VM_ENTRY_FD || type == VM_ENTRY_REDIR;
+    return type == VM_ENTRY_FD || type == VM_ENTRY_REDIR || type == VM_ENTRY_HOLE;
 }
 
 bool is_vm_entry_str(vm_entry_type_t type)
 {
-    return type == VM_ENTRY_NAME || type == VM_ENTRY_PARTIAL
-            || type == VM_ENTRY_WORD;
+    return type == VM_ENTRY_PARTIAL || type == VM_ENTRY_WORD;
 }
 
 vm_entry_t *make_vm_entry(vm_entry_type_t type)
 {
     if (!is_vm_entry_no_payload(type)) return NULL;
-    vm_entry_t *e = malloc(sizeof(vm_entry_t));
+    vm_entry_t *e = vm_entry_alloc(sizeof(vm_entry_t));
     if (e == NULL) return NULL;
     e->type = type;
     return (vm_entry_t *)e;
@@ -58,7 +87,7 @@ vm_entry_t *make_vm_entry(vm_entry_type_t type)
 vm_entry_t *make_vm_entry_int(vm_entry_type_t type, int payload)
 {
     if (!is_vm_entry_int(type)) return NULL;
-    vm_entry_int_t *e = malloc(sizeof(vm_entry_int_t));
+    vm_entry_int_t *e = vm_entry_alloc(sizeof(vm_entry_int_t));
     if (e == NULL) return NULL;
     e->type = type;
     e->pl_int = payload;
@@ -70,7 +99,7 @@ vm_entry_t *make_vm_entry_str(vm_entry_type_t type, const char *payload)
     if (!is_vm_entry_str(type) || payload == NULL) return NULL;
     size_t pl_len = strlen(payload);
     if (pl_len > INT_MAX) return NULL;
-    vm_entry_str_t *e = malloc(sizeof(vm_entry_str_t) + pl_len + 1);
+    vm_entry_str_t *e = vm_entry_alloc(sizeof(vm_entry_str_t) + pl_len + 1);
     if (e == NULL) return NULL;
     e->type = type;
     memcpy(e->pl_str, payload, pl_len);
@@ -81,15 +110,39 @@ vm_entry_t *make_vm_entry_str(vm_entry_type_t type, const char *payload)
 vm_entry_t *make_vm_entry_assign(const char *name, const char *val)
 {
     if (name == NULL || val == NULL) return NULL;
-    vm_entry_assign_t *e = malloc(sizeof(vm_entry_assign_t));
+    vm_entry_assign_t *e = vm_entry_alloc(sizeof(vm_entry_assign_t));
     if (e == NULL) return NULL;
     e->type = VM_ENTRY_ASSIGN_WORD;
-    e->pl_name = strdup(name);
-    e->pl_val = strdup(val);
+    e->pl_name = entry_strdup(name);
+    e->pl_val = entry_strdup(val);
     if (e->pl_val == NULL || e->pl_name == NULL) {
-        if (e->pl_name != NULL) free(e->pl_name);
-        if (e->pl_val != NULL) free(e->pl_val);
-        free(e);
+        if (e->pl_name != NULL) vm_entry_release(e->pl_name);
+        if (e->pl_val != NULL) vm_entry_release(e->pl_val);
+        vm_entry_release(e);
+        return NULL;
+    }
+    return (vm_entry_t *)e;
+}
+
+// Splits a `name=value` word at its first '='.
+vm_entry_t *make_vm_entry_assign_word(const char *word)
+{
+    if (word == NULL) return NULL;
+    const char *val = strchr(word, '=');
+    if (val == NULL) return NULL;
+    vm_entry_assign_t *e = vm_entry_alloc(sizeof(vm_entry_assign_t));
+    if (e == NULL) return NULL;
+    e->type = VM_ENTRY_ASSIGN_WORD;
+    e->pl_name = vm_entry_alloc(val - word + 1);
+    e->pl_val = entry_strdup(val + 1);
+    if (e->pl_name != NULL) {
+        memcpy(e->pl_name, word, val - word);
+        e->pl_name[val - word] = '\0';
+    }
+    if (e->pl_val == NULL || e->pl_name == NULL) {
+        if (e->pl_name != NULL) vm_entry_release(e->pl_name);
+        if (e->pl_val != NULL) vm_entry_release(e->pl_val);
+        vm_entry_release(e);
         return NULL;
     }
     return (vm_entry_t *)e;
@@ -99,7 +152,7 @@ vm_entry_t *make_vm_entry_ioredir_fd(io_redir_type_t redir_type, int fd, int fd2
 {
     if (redir_type != IO_REDIR_INPUT_DUP && redir_type != IO_REDIR_OUTPUT_DUP) return NULL;
     if (fd < 0 || fd2 < 0) return NULL;
-    vm_entry_ioredir_t *e = malloc(sizeof(vm_entry_ioredir_t));
+    vm_entry_ioredir_t *e = vm_entry_alloc(sizeof(vm_entry_ioredir_t));
     if (e == NULL) return NULL;
     e->type = VM_ENTRY_IOREDIR;
     e->redir_type = redir_type;
@@ -114,7 +167,7 @@ vm_entry_t *make_vm_entry_ioredir_path(io_redir_type_t redir_type, int fd, const
     if (fd < 0 || path == NULL) return NULL;
     size_t pl_len = strlen(path);
     if (pl_len > INT_MAX) return NULL;
-    vm_entry_ioredir_t *e = malloc(sizeof(vm_entry_ioredir_t) + pl_len + 1);
+    vm_entry_ioredir_t *e = vm_entry_alloc(sizeof(vm_entry_ioredir_t) + pl_len + 1);
     if (e == NULL) return NULL;
     e->type = VM_ENTRY_IOREDIR;
     e->redir_type = redir_type;
@@ -127,7 +180,7 @@ vm_entry_t *make_vm_entry_ioredir_path(io_redir_type_t redir_type, int fd, const
 vm_entry_t *make_vm_entry_command(vm_entry_str_t **args, vm_entry_assign_t **assigns, vm_entry_ioredir_t **redirs)
 {
     if (args == NULL || assigns == NULL || redirs == NULL) return NULL;
-    vm_entry_command_t *e = malloc(sizeof(vm_entry_command_t));
+    vm_entry_command_t *e = vm_entry_alloc(sizeof(vm_entry_command_t));
     if (e == NULL) return NULL;
     e->type = VM_ENTRY_COMMAND;
     e->args = args;
@@ -135,6 +188,7 @@ vm_entry_t *make_vm_entry_command(vm_entry_str_t **args, vm_entry_assign_t **ass
     e->redirs = redirs;
     e->pipe_in = -1;
     e->pipe_out = -1;
+    e->tmpl = NULL;
     return (vm_entry_t *)e;
 }
 
@@ -147,7 +201,7 @@ vm_entry_t *make_vm_entry_pipeline(vm_entry_t *left, vm_entry_command_t *right)
     }
 
     if (left->type == VM_ENTRY_COMMAND) {
-        vm_entry_pipeline_t *e = malloc(sizeof(vm_entry_pipeline_t *) + sizeof(vm_entry_command_t *) * 3);
+        vm_entry_pipeline_t *e = vm_entry_alloc(sizeof(vm_entry_pipeline_t *) + sizeof(vm_entry_command_t *) * 3);
         if (e == NULL) return NULL;
         e->type = VM_ENTRY_PIPELINE;
         e->commands[0] = (vm_entry_command_t *)left;
@@ -160,8 +214,10 @@ vm_entry_t *make_vm_entry_pipeline(vm_entry_t *left, vm_entry_command_t *right)
     vm_entry_pipeline_t *pe = (vm_entry_pipeline_t *)left;
     for (vm_entry_command_t **c = pe->commands; *c != NULL; ++c) ++pipeline_len;
     if (pipeline_len < 0) return NULL;
-    vm_entry_pipeline_t *e = realloc(left, sizeof(vm_entry_pipeline_t *) + sizeof(vm_entry_command_t *) * ((size_t)pipeline_len + 1));
+    vm_entry_pipeline_t *e = vm_entry_alloc(sizeof(vm_entry_pipeline_t *) + sizeof(vm_entry_command_t *) * ((size_t)pipeline_len + 1));
     if (e == NULL) return NULL;
+    memcpy(e, left, sizeof(vm_entry_pipeline_t *) + sizeof(vm_entry_command_t *) * (size_t)pipeline_len);
+    vm_entry_release(left);
     e->commands[pipeline_len - 1] = right;
     e->commands[pipeline_len] = NULL;
 
@@ -171,29 +227,64 @@ vm_entry_t *make_vm_entry_pipeline(vm_entry_t *left, vm_entry_command_t *right)
 void free_vm_entry_assign(vm_entry_assign_t *e)
 {
     if (e == NULL) return;
-    if (e->pl_name != NULL) free(e->pl_name);
-    if (e->pl_val != NULL) free(e->pl_val);
-    free(e);
+    if (e->pl_name != NULL) vm_entry_release(e->pl_name);
+    if (e->pl_val != NULL) vm_entry_release(e->pl_val);
+    vm_entry_release(e);
 }
 
 void free_vm_entry_command(vm_entry_command_t *e)
 {
     if (e == NULL) return;
+    if (e->tmpl != NULL) {
+        vm_template_t *t = e->tmpl;
+        for (int i = 0; i < t->hole_count; ++i) {
+            int index = t->holes[i].index;
+            switch (t->holes[i].type) {
+            case IL_HOLE_ARG:
+                vm_entry_release(e->args[index]);
+                e->args[index] = NULL;
+                break;
+            case IL_HOLE_ASSIGN:
+                free_vm_entry_assign(e->assigns[index]);
+                e->assigns[index] = NULL;
+                break;
+            case IL_HOLE_REDIR:
+                vm_entry_release(e->redirs[index]);
+                e->redirs[index] = NULL;
+                break;
+            }
+        }
+        e->pipe_in = e->pipe_out = -1;
+        return;
+    }
     if (e->args != NULL) {
-        for (vm_entry_str_t **pe = e->args; *pe != NULL; ++pe) free(*pe);
-        free(e->args);
+        for (vm_entry_str_t **pe = e->args; *pe != NULL; ++pe) vm_entry_release(*pe);
+        vm_entry_release(e->args);
     }
     if (e->assigns != NULL) {
         for (vm_entry_assign_t **pe = e->assigns; *pe != NULL; ++pe) {
             free_vm_entry_assign(*pe);
         }
-        free(e->assigns);
+        vm_entry_release(e->assigns);
     }
     if (e->redirs != NULL) {
-        for (vm_entry_ioredir_t **pe = e->redirs; *pe != NULL; ++pe) free(*pe);
-        free(e->redirs);
+        for (vm_entry_ioredir_t **pe = e->redirs; *pe != NULL; ++pe) vm_entry_release(*pe);
+        vm_entry_release(e->redirs);
     }
-    free(e);
+    vm_entry_release(e);
+}
+
+void free_vm_template(vm_template_t *t)
+{
+    if (t == NULL) return;
+    vm_entry_command_t *e = &t->command;
+    for (int i = 0; i < t->arg_count; ++i) vm_entry_release(e->args[i]);
+    for (int i = 0; i < t->assign_count; ++i) free_vm_entry_assign(e->assigns[i]);
+    for (int i = 0; i < t->redir_count; ++i) vm_entry_release(e->redirs[i]);
+    vm_entry_release(e->args);
+    vm_entry_release(e->assigns);
+    vm_entry_release(e->redirs);
+    vm_entry_release(t);
 }
 
 void free_vm_entry_pipeline(vm_entry_pipeline_t *e)
@@ -202,7 +293,7 @@ void free_vm_entry_pipeline(vm_entry_pipeline_t *e)
     for (vm_entry_command_t **c = e->commands; *c != NULL; ++c) {
         free_vm_entry_command(*c);
     }
-    free(e);
+    vm_entry_release(e);
 }
 
 void free_vm_entry(vm_entry_t *e)
@@ -219,7 +310,7 @@ void free_vm_entry(vm_entry_t *e)
         free_vm_entry_pipeline((vm_entry_pipeline_t *)e);
         return;
     default:
-        free(e);
+        vm_entry_release(e);
         return;
     }
 }
@@ -6,6 +6,7 @@
 #define VM_ENTRY_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "il.h"
 
 typedef enum vm_entry_type_e {
@@ -15,11 +16,11 @@ typedef enum vm_entry_type_e {
     VM_ENTRY_PENDING_NOT,
 
     // Primitive payload type
-    VM_ENTRY_NAME,
     VM_ENTRY_PARTIAL,
     VM_ENTRY_FD,
     VM_ENTRY_REDIR,
     VM_ENTRY_WORD,
+    VM_ENTRY_HOLE,
 
     // Complex payload type
     VM_ENTRY_ASSIGN_WORD,
@@ -56,6 +57,8 @@ typedef struct vm_entry_ioredir_s {
     char pl_path[];
 } vm_entry_ioredir_t;
 
+typedef struct vm_template_s vm_template_t;
+
 typedef struct vm_entry_command_s {
     vm_entry_type_t type;
     vm_entry_str_t **args;
@@ -63,8 +66,23 @@ typedef struct vm_entry_command_s {
     vm_entry_ioredir_t **redirs;
     int pipe_in;
     int pipe_out;
+    vm_template_t *tmpl;  // owns this command if not NULL
 } vm_entry_command_t;
 
+// A command frozen on its first run. Freeing the command only frees what was
+// filled into its holes; the rest is kept for the next run.
+typedef struct vm_template_s {
+    vm_entry_command_t command;
+    int arg_count;
+    int assign_count;
+    int redir_count;
+    int hole_count;
+    struct vm_hole_s {
+        il_hole_t type;
+        int index;  // in args, assigns or redirs
+    } holes[];
+} vm_template_t;
+
 typedef struct vm_entry_pipeline_s {
     vm_entry_type_t type;
     vm_entry_command_t *commands[];
@@ -72,6 +90,10 @@ typedef struct vm_entry_pipeline_s {
 
 const char *vm_entry_type_name(vm_entry_type_t type);
 
+bool vm_entry_alloc_on_heap(bool on_heap);
+void *vm_entry_alloc(size_t size);
+void vm_entry_release(void *ptr);
+
 bool is_vm_entry_no_payload(vm_entry_type_t type);
 bool is_vm_entry_int(vm_entry_type_t type);
 bool is_vm_entry_str(vm_entry_type_t type);
@@ -80,6 +102,7 @@ vm_entry_t *make_vm_entry(vm_entry_type_t type);
 vm_entry_t *make_vm_entry_int(vm_entry_type_t type, int payload);
 vm_entry_t *make_vm_entry_str(vm_entry_type_t type, const char *payload);
 vm_entry_t *make_vm_entry_assign(const char *name, const char *val);
+vm_entry_t *make_vm_entry_assign_word(const char *word);
 vm_entry_t *make_vm_entry_ioredir_fd(io_redir_type_t redir_type, int fd, int fd2);
 vm_entry_t *make_vm_entry_ioredir_path(io_redir_type_t redir_type, int fd, const char *path);
 vm_entry_t *make_vm_entry_command(vm_entry_str_t **args, vm_entry_assign_t **assigns, vm_entry_ioredir_t **redirs);
@@ -88,6 +111,7 @@ vm_entry_t *make_vm_entry_pipeline(vm_entry_t *left, vm_entry_command_t *right);
 void free_vm_entry_assign(vm_entry_assign_t *e);
 void free_vm_entry_command(vm_entry_command_t *e);
 void free_vm_entry_pipeline(vm_entry_pipeline_t *e);
+void free_vm_template(vm_template_t *t);
 void free_vm_entry(vm_entry_t *e);
 
 void print_vm_entry(vm_entry_t *e, int indent);
@@ -12,7 +12,7 @@ static bool vm_stack_try_expand(vm_stack_t *stack)
     if (stack->size + 1 < stack->capacity) return true;
     int new_cap = stack->capacity + stack->capacity / 2;
     if (new_cap < min_cap) return false;
-    vm_entry_t **new_arr = realloc(stack->entries, new_cap);
+    vm_entry_t **new_arr = realloc(stack->entries, sizeof(vm_entry_t *) * new_cap);
     if (new_arr == NULL) return false;
     stack->entries = new_arr;
     stack->capacity = new_cap;
@@ -24,7 +24,8 @@ static void vm_stack_try_shrink(vm_stack_t *stack)
     if (stack->size > stack->capacity / 4) return;
     int new_cap = stack->capacity / 2;
     if (new_cap < min_cap) new_cap = min_cap;
-    vm_entry_t **new_arr = realloc(stack->entries, new_cap);
+    if (new_cap == stack->capacity) return;
+    vm_entry_t **new_arr = realloc(stack->entries, sizeof(vm_entry_t *) * new_cap);
     if (new_arr == NULL) return;
     stack->entries = new_arr;
     stack->capacity = new_cap;
@@ -52,6 +53,14 @@ void vm_stack_free(vm_stack_t *stack)
     stack->size = 0;
 }
 
+// Frees all the entries, but keeps the stack for reuse.
+void vm_stack_clear(vm_stack_t *stack)
+{
+    if (stack == NULL || stack->entries == NULL) return;
+    for (int i = 0; i < stack->size; ++i) free_vm_entry(stack->entries[i]);
+    stack->size = 0;
+}
+
 bool vm_stack_valid(vm_stack_t *stack)
 {
     return stack != NULL && stack->entries != NULL
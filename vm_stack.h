@@ -16,6 +16,7 @@ typedef struct vm_stack_s {
 
 bool vm_stack_init(vm_stack_t *stack);
 void vm_stack_free(vm_stack_t *stack);
+void vm_stack_clear(vm_stack_t *stack);
 bool vm_stack_valid(vm_stack_t *stack);
 bool vm_stack_push(vm_stack_t *stack, vm_entry_t *entry);
 vm_entry_t *vm_stack_pop(vm_stack_t *stack);
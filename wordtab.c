@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "wordtab.h"
+#include "builtin.h"
+#include "utils.h"
+
+static const struct {
+    const char *name;
+    token_type_t type;
+} keywords[] = {
+    { "for",    TOKEN_FOR },
+    { "in",     TOKEN_IN },
+    { "do",     TOKEN_DO },
+    { "done",   TOKEN_DONE },
+    { "case",   TOKEN_CASE },
+    { "esac",   TOKEN_ESAC },
+    { "while",  TOKEN_WHILE },
+    { "until",  TOKEN_UNTIL },
+    { "select", TOKEN_SELECT },
+    { "if",     TOKEN_IF },
+    { "else",   TOKEN_ELSE },
+    { "elif",   TOKEN_ELIF },
+    { "fi",     TOKEN_FI },
+};
+
+static const size_t KEYWORDS_COUNT = sizeof(keywords) / sizeof(keywords[0]);
+
+// Keywords and builtins share one perfect hash table: wordtab_init() looks for
+// a seed under which no two words fall into the same slot, so a lookup is a
+// single hash and compare however many builtins are registered.
+static word_t *slots = NULL;
+static uint32_t slots_mask = 0;
+static uint32_t seed = 0;
+static size_t max_len = 0;
+
+static uint32_t word_hash(uint32_t h, const char *str, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (uint8_t)str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool word_insert(word_t *table, uint32_t mask, uint32_t try_seed, const word_t *word)
+{
+    word_t *slot = &table[word_hash(try_seed, word->name, word->len) & mask];
+    if (slot->name != NULL) return false;
+    *slot = *word;
+    return true;
+}
+
+static bool wordtab_build(word_t *table, uint32_t size, uint32_t try_seed)
+{
+    memset(table, 0, size * sizeof(word_t));
+    for (size_t i = 0; i < KEYWORDS_COUNT; ++i) {
+        word_t word = { keywords[i].name, strlen(keywords[i].name), WORD_KEYWORD, keywords[i].type, NULL };
+        if (!word_insert(table, size - 1, try_seed, &word)) return false;
+    }
+    for (size_t i = 0; i < builtins_count; ++i) {
+        word_t word = { builtins[i].name, strlen(builtins[i].name), WORD_BUILTIN, TOKEN_INVALID, &builtins[i] };
+        if (!word_insert(table, size - 1, try_seed, &word)) return false;
+    }
+    return true;
+}
+
+void wordtab_init(void)
+{
+    if (slots != NULL) return;
+    size_t count = KEYWORDS_COUNT + builtins_count;
+    uint32_t size = 16;
+    while (size < count * 2) size *= 2;
+
+    for (; size <= 65536; size *= 2) {
+        word_t *table = malloc(size * sizeof(word_t));
+        if (table == NULL) panic("Can't allocate word table");
+        for (uint32_t try_seed = 2166136261u; try_seed < 2166136261u + 4096; ++try_seed) {
+            if (!wordtab_build(table, size, try_seed)) continue;
+            slots = table;
+            slots_mask = size - 1;
+            seed = try_seed;
+            for (uint32_t i = 0; i < size; ++i) {
+                if (table[i].len > max_len) max_len = table[i].len;
+            }
+            return;
+        }
+        free(table);
+    }
+    panic("Can't build word table");
+}
+
+const word_t *wordtab_lookup(const char *str, size_t len)
+{
+    if (len > max_len || slots == NULL) return NULL;
+    const word_t *word = &slots[word_hash(seed, str, len) & slots_mask];
+    if (word->name == NULL || word->len != len || memcmp(word->name, str, len) != 0) return NULL;
+    return word;
+}
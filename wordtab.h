@@ -0,0 +1,27 @@
+#ifndef WORDTAB_H
+#define WORDTAB_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "lexer.h"
+
+typedef struct builtin_s builtin_t;
+
+typedef enum word_kind_e {
+    WORD_KEYWORD,
+    WORD_BUILTIN,
+} word_kind_t;
+
+// A reserved word or a builtin command name
+typedef struct word_s {
+    const char *name;
+    size_t len;
+    word_kind_t kind;
+    token_type_t keyword;       // for WORD_KEYWORD
+    const builtin_t *builtin;   // for WORD_BUILTIN
+} word_t;
+
+void wordtab_init(void);
+const word_t *wordtab_lookup(const char *str, size_t len);
+
+#endif // WORDTAB_H